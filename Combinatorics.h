@@ -4,6 +4,7 @@
 #define LINEPLANNING_COMBINATORICS_H
 
 #include <vector>
+#include <algorithm>
 
 namespace Combinatorics {
 
@@ -79,6 +80,30 @@ namespace Combinatorics {
         }
     }
 
+    // a Gray code through the compositions of k into n parts: consecutive compositions differ by one unit moved from
+    // part first to part second. It starts at (k,0,...,0), ends at (0,...,0,k) and is appended backwards if reversed.
+    inline void composition_gray_moves(unsigned int k, unsigned int n, bool reversed, vector<pair<unsigned int, unsigned int>> &moves)
+    {
+        if (n < 2 || k == 0)
+            return;
+        if (reversed)
+        {
+            auto start = moves.size();
+            composition_gray_moves(k, n, false, moves);
+            std::reverse(moves.begin()+start, moves.end());
+            for (auto it = moves.begin()+start; it != moves.end(); it++)
+                std::swap(it->first, it->second);
+            return;
+        }
+        //blocks by the value c of the last part, the others run alternately forwards and backwards
+        for (unsigned int c = 0; c <= k; c++)
+        {
+            composition_gray_moves(k-c, n-1, c%2 == 1, moves);
+            if (c < k)
+                moves.emplace_back(c%2 == 0 ? n-2 : 0, n-1);
+        }
+    }
+
     template <class Opt>
     class SequenceOfChoices {
 
@@ -177,6 +202,67 @@ namespace Combinatorics {
             it.expired = true;
             return it;
         }
+
+        unsigned int size() const{
+            return stages.size();
+        }
+
+        const Opt& option(unsigned int stage, unsigned int i) const{
+            return stages[stage].options[i];
+        }
+
+        unsigned int optionCount(unsigned int stage) const{
+            return stages[stage].options.size();
+        }
+
+        // one unit of a stage moved from option from to option to
+        struct Move {
+            unsigned int stage, from, to;
+        };
+
+        // visits the same choices as iterator, but consecutive choices differ by a single move (reflected Gray code over
+        // the stages). The first choice puts all k units of every stage on its first option.
+        class gray_walk {
+            struct StageWalk {
+                vector<pair<unsigned int, unsigned int>> moves;
+                unsigned int position = 0;
+                bool forward = true;
+            };
+            vector<StageWalk> walks;
+        public:
+            explicit gray_walk(const SequenceOfChoices &soc) : walks(soc.stages.size())
+            {
+                for (unsigned int i = 0; i < walks.size(); i++)
+                    composition_gray_moves(soc.stages[i].k, soc.stages[i].options.size(), false, walks[i].moves);
+            }
+
+            // moves to the next choice, false if all choices have been visited
+            bool next(Move &move)
+            {
+                for (unsigned int i = 0; i < walks.size(); i++)
+                {
+                    auto &w = walks[i];
+                    if (w.forward && w.position < w.moves.size())
+                    {
+                        auto m = w.moves[w.position++];
+                        move = {i, m.first, m.second};
+                        return true;
+                    }
+                    if (!w.forward && w.position > 0)
+                    {
+                        auto m = w.moves[--w.position];
+                        move = {i, m.second, m.first};
+                        return true;
+                    }
+                    w.forward = !w.forward;
+                }
+                return false;
+            }
+        };
+
+        gray_walk walk() const{
+            return gray_walk(*this);
+        }
     };
 
 }
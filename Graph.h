@@ -265,12 +265,19 @@ public:
 
     template<class EW, class WeightConverter>
     static RootedNodeWeightedTree fromGraph(const WeightedIndexedGraph<EW> &graph, WeightConverter wc)
+    {
+        return fromGraph(graph, wc, graph.nodes.begin()->second, graph.nodeCount());
+    }
+
+    // the tree of the connected component of root, which has nodeCount nodes
+    template<class EW, class WeightConverter>
+    static RootedNodeWeightedTree fromGraph(const WeightedIndexedGraph<EW> &graph, WeightConverter wc, typename WeightedIndexedGraph<EW>::Node *root, unsigned int nodeCount)
     {
         typedef WeightedIndexedGraph<EW> Graph;
         typedef typename Graph::Node GN;
         typedef typename Graph::Edge GE;
         //typedef std::pair<typename Graph::Node*, typename Graph::Edge*> W;
-        RootedNodeWeightedTree tree(graph.nodeCount());
+        RootedNodeWeightedTree tree(nodeCount);
         unsigned int ai = 0;
 
         struct Work{
@@ -279,7 +286,6 @@ public:
             NodeRef parent;
         };
         std::vector<Work> worklist;
-        GN* root = graph.nodes.begin()->second;
         worklist.push_back({root, nullptr, (unsigned int)-1});
         std::unordered_map<GN*, bool> added;
         added[root] = true;
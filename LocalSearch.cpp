@@ -0,0 +1,327 @@
+
+#include "LocalSearch.h"
+#include <random>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <numeric>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+
+
+namespace LinePlanning {
+
+    namespace {
+
+        typedef chrono::steady_clock Clock;
+
+        // smaller cost changes are rounding noise and do not count as improvement
+        constexpr double minGain = 1e-9;
+
+        struct WorkLine {
+            Line line;
+            vector<int> path; // stops of the line, path.front() == path.back() for a cycle
+
+            bool isCycle() const {
+                return path.size() > 2 && path.front() == path.back();
+            }
+
+            // orients the line to end at stop v, which has to be one of its ends
+            void endAt(int v) {
+                if (path.back() != v) {
+                    std::reverse(line.edges.begin(), line.edges.end());
+                    std::reverse(path.begin(), path.end());
+                }
+            }
+        };
+
+        // one local search run on its own copy of the line concept, the edge loads are updated with every move
+        class Search {
+            const Instance &instance;
+            vector<WorkLine> lines;
+            unordered_map<Line::Edge, unsigned int> load;
+            mt19937 rng;
+            Clock::time_point deadline;
+
+            const EdgeInfoEx& info(Line::Edge e) const {
+                return instance.graph.getEdge(e)->weight;
+            }
+
+            // frequency that can be taken from e without falling below f_min
+            unsigned int slackBelow(Line::Edge e) const {
+                auto l = load.at(e);
+                return l - std::min(l, info(e).f_min);
+            }
+
+            // frequency that can be added to e without exceeding f_max
+            unsigned int slackAbove(Line::Edge e) const {
+                auto it = load.find(e);
+                unsigned int l = it == load.end() ? 0 : it->second;
+                return info(e).f_max - std::min(l, info(e).f_max);
+            }
+
+            bool timeUp() const {
+                return Clock::now() >= deadline;
+            }
+
+            template <class T>
+            void shuffle(vector<T> &v) {
+                std::shuffle(v.begin(), v.end(), rng);
+            }
+
+            vector<size_t> shuffledLines() {
+                vector<size_t> order(lines.size());
+                std::iota(order.begin(), order.end(), 0);
+                shuffle(order);
+                return order;
+            }
+
+            // moves frequency f of line i to a copy of it, returns the index of the copy (i if f is all of it)
+            size_t split(size_t i, unsigned int f) {
+                if (f == lines[i].line.frequency)
+                    return i;
+                lines[i].line.frequency -= f;
+                WorkLine copy = lines[i];
+                copy.line.frequency = f;
+                lines.push_back(std::move(copy));
+                return lines.size()-1;
+            }
+
+            // whether the lines share no stop apart from shared
+            static bool disjoint(const WorkLine &l1, const WorkLine &l2, int shared) {
+                unordered_set<int> stops(l1.path.begin(), l1.path.end());
+                for (auto v : l2.path) {
+                    if (v != shared && stops.contains(v))
+                        return false;
+                }
+                return true;
+            }
+
+            // the ends of all lines with nonzero frequency that are not cycles
+            unordered_map<int, vector<size_t>> lineEnds() const {
+                unordered_map<int, vector<size_t>> ends;
+                for (size_t i = 0; i < lines.size(); i++) {
+                    if (lines[i].line.frequency == 0 || lines[i].isCycle())
+                        continue;
+                    ends[lines[i].path.front()].push_back(i);
+                    ends[lines[i].path.back()].push_back(i);
+                }
+                return ends;
+            }
+
+            // adds a line of frequency f: line i, then bridge (if any), then line j backwards.
+            // Both lines have to be oriented towards the connection point, their frequencies are reduced by f.
+            void appendJoined(size_t i, size_t j, unsigned int f, const InstanceGraph::Edge *bridge) {
+                Line first = lines[i].line;
+                if (bridge != nullptr) {
+                    first.edges.push_back(bridge->index);
+                    load[bridge->index] += f;
+                }
+                WorkLine joined{merge(f, first, lines[j].line), lines[i].path};
+                joined.path.insert(joined.path.end(), lines[j].path.rbegin()+(bridge == nullptr ? 1 : 0), lines[j].path.rend());
+                lines[i].line.frequency -= f;
+                lines[j].line.frequency -= f;
+                lines.push_back(std::move(joined));
+            }
+
+            bool dropFrequency() {
+                bool improved = false;
+                for (auto i : shuffledLines()) {
+                    if (timeUp())
+                        break;
+                    auto &l = lines[i];
+                    auto d = l.line.frequency;
+                    double lineCost = instance.c_fix;
+                    for (auto e : l.line.edges) {
+                        d = std::min(d, slackBelow(e));
+                        lineCost += info(e).cost;
+                    }
+                    if (d == 0 || d*lineCost <= minGain)
+                        continue;
+                    for (auto e : l.line.edges) {
+                        load[e] -= d;
+                    }
+                    l.line.frequency -= d;
+                    moves++;
+                    improved = true;
+                }
+                return improved;
+            }
+
+            bool shortenEnds() {
+                bool improved = false;
+                for (auto i : shuffledLines()) {
+                    if (timeUp())
+                        break;
+                    for (bool atBack : {false, true}) {
+                        const auto &l = lines[i];
+                        if (l.line.frequency == 0 || l.isCycle() || l.line.edges.size() < 2)
+                            break;
+                        auto e = atBack ? l.line.edges.back() : l.line.edges.front();
+                        auto d = std::min(l.line.frequency, slackBelow(e));
+                        if (d == 0 || d*info(e).cost <= minGain)
+                            continue;
+                        auto &s = lines[split(i, d)];
+                        if (atBack) {
+                            s.line.edges.pop_back();
+                            s.path.pop_back();
+                        } else {
+                            s.line.edges.erase(s.line.edges.begin());
+                            s.path.erase(s.path.begin());
+                        }
+                        load[e] -= d;
+                        moves++;
+                        improved = true;
+                    }
+                }
+                return improved;
+            }
+
+            bool mergeAtStops() {
+                if (instance.c_fix <= 0)
+                    return false;
+                bool improved = false;
+                auto ends = lineEnds();
+                vector<int> stops;
+                for (const auto &[v, _] : ends) {
+                    stops.push_back(v);
+                }
+                shuffle(stops);
+                vector<bool> touched(lines.size(), false);
+                for (auto x : stops) {
+                    if (timeUp())
+                        break;
+                    auto &candidates = ends[x];
+                    shuffle(candidates);
+                    for (size_t a = 0; a < candidates.size(); a++) {
+                        for (size_t b = a+1; b < candidates.size(); b++) {
+                            auto i = candidates[a], j = candidates[b];
+                            if (touched[i] || touched[j] || !disjoint(lines[i], lines[j], x))
+                                continue;
+                            auto f = std::min(lines[i].line.frequency, lines[j].line.frequency);
+                            lines[i].endAt(x);
+                            lines[j].endAt(x);
+                            appendJoined(i, j, f, nullptr);
+                            touched[i] = touched[j] = true;
+                            moves++;
+                            improved = true;
+                        }
+                    }
+                }
+                return improved;
+            }
+
+            bool connectEnds() {
+                bool improved = false;
+                auto ends = lineEnds();
+                vector<bool> touched(lines.size(), false);
+                for (auto i : shuffledLines()) {
+                    if (timeUp())
+                        break;
+                    if (touched[i] || lines[i].line.frequency == 0 || lines[i].isCycle())
+                        continue;
+                    for (auto a : {lines[i].path.front(), lines[i].path.back()}) {
+                        if (touched[i])
+                            break;
+                        for (auto [edge, neighbor] : instance.graph.nodes.at(a)->getNeighborhood()) {
+                            auto saving = instance.c_fix-edge->weight.cost;
+                            auto capacity = slackAbove(edge->index);
+                            auto it = ends.find(neighbor->index);
+                            if (saving <= 0 || capacity == 0 || it == ends.end())
+                                continue;
+                            for (auto j : it->second) {
+                                if (j == i || touched[j] || !disjoint(lines[i], lines[j], -1))
+                                    continue;
+                                auto f = std::min({lines[i].line.frequency, lines[j].line.frequency, capacity});
+                                if (f*saving <= minGain)
+                                    continue;
+                                lines[i].endAt(a);
+                                lines[j].endAt(neighbor->index);
+                                appendJoined(i, j, f, edge);
+                                touched[i] = touched[j] = true;
+                                moves++;
+                                improved = true;
+                                break;
+                            }
+                            if (touched[i])
+                                break;
+                        }
+                    }
+                }
+                return improved;
+            }
+
+            void removeEmptyLines() {
+                std::erase_if(lines, [](const WorkLine &l) {return l.line.frequency == 0;});
+            }
+
+        public:
+            unsigned long long moves = 0;
+
+            Search(const Instance &instance, const LineConcept &lineConcept, unsigned int seed, Clock::time_point deadline)
+                : instance(instance), rng(seed), deadline(deadline) {
+                for (const auto &line : lineConcept.lines) {
+                    if (line.frequency == 0 || line.edges.empty())
+                        continue;
+                    lines.push_back({line, line.toVertexPath(&instance)});
+                    for (auto e : line.edges) {
+                        load[e] += line.frequency;
+                    }
+                }
+            }
+
+            // applies improving moves until none is left or the time is up
+            void run() {
+                while (!timeUp()) {
+                    bool improved = false;
+                    improved |= dropFrequency();
+                    improved |= shortenEnds();
+                    improved |= mergeAtStops();
+                    improved |= connectEnds();
+                    removeEmptyLines();
+                    if (!improved)
+                        break;
+                }
+            }
+
+            LineConcept result() const {
+                LineConcept lc;
+                for (const auto &l : lines) {
+                    lc.appendLine(l.line);
+                }
+                return lc;
+            }
+        };
+    }
+
+    LocalSearchResult improveLocally(const Instance &instance, const LineConcept &lineConcept, const LocalSearchOptions &options) {
+        auto deadline = Clock::now()+chrono::duration_cast<Clock::duration>(chrono::duration<double>(std::min(options.timeLimit, 1e7)));
+        unsigned int threads = options.threads != 0 ? options.threads : std::max(1u, thread::hardware_concurrency());
+
+        vector<future<pair<LineConcept, unsigned long long>>> futures;
+        for (unsigned int t = 0; t < threads; t++) {
+            futures.push_back(std::async(std::launch::async, [&, t]() {
+                Search search(instance, lineConcept, options.seed+t, deadline);
+                search.run();
+                return make_pair(search.result(), search.moves);
+            }));
+        }
+
+        LocalSearchResult result;
+        result.lineConcept = lineConcept;
+        result.costBefore = result.costAfter = lineConcept.calcCost(instance).costTotal;
+        for (auto &f : futures) {
+            auto [lc, moves] = f.get();
+            auto cost = lc.calcCost(instance).costTotal;
+            if (cost < result.costAfter-minGain) {
+                result.lineConcept = std::move(lc);
+                result.costAfter = cost;
+                result.moves = moves;
+            }
+        }
+        return result;
+    }
+}
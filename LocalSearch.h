@@ -0,0 +1,32 @@
+
+#ifndef LINEPLANNING_LOCALSEARCH_H
+#define LINEPLANNING_LOCALSEARCH_H
+
+#include "LinePlanning.h"
+
+namespace LinePlanning {
+
+    struct LocalSearchOptions {
+        double timeLimit = 1; // seconds
+        unsigned int threads = 0; // independent runs, 0 for one per hardware thread
+        unsigned int seed = 1;
+    };
+
+    struct LocalSearchResult {
+        LineConcept lineConcept;
+        double costBefore = 0;
+        double costAfter = 0;
+        unsigned long long moves = 0; // applied moves of the best run
+    };
+
+    /*
+     * Improves a feasible line concept by moves that decrease the cost and keep it feasible:
+     * dropping frequency that no edge needs for its f_min, shortening line ends, merging two lines that end at the same stop
+     * (saves c_fix) and connecting two line ends by an edge with spare capacity.
+     * Cycles are kept as they are apart from dropping frequency. Runs with different random move orders in parallel
+     * until no move improves or the time limit is reached, and returns the best result.
+     */
+    LocalSearchResult improveLocally(const Instance &instance, const LineConcept &lineConcept, const LocalSearchOptions &options = {});
+}
+
+#endif //LINEPLANNING_LOCALSEARCH_H
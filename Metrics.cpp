@@ -0,0 +1,161 @@
+
+#include "Metrics.h"
+#include <fstream>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+
+namespace Metrics {
+
+    namespace {
+
+        double wallTime() {
+            return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    string jsonString(const string &s) {
+        string escaped = "\"";
+        for (char c : s) {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c == '\n' ? ' ' : c;
+        }
+        return escaped+"\"";
+    }
+
+    void Registry::addStage(StageRecord record) {
+        lock_guard lock(mutex);
+        stages.push_back(std::move(record));
+    }
+
+    void Registry::addNode(NodeRecord record) {
+        lock_guard lock(mutex);
+        nodes.push_back(std::move(record));
+    }
+
+    void Registry::setValue(const string &name, double value) {
+        lock_guard lock(mutex);
+        values[name] = value;
+    }
+
+    void Registry::addToValue(const string &name, double value) {
+        lock_guard lock(mutex);
+        values[name] += value;
+    }
+
+    void Registry::clear() {
+        lock_guard lock(mutex);
+        stages.clear();
+        nodes.clear();
+        values.clear();
+    }
+
+    vector<StageRecord> Registry::getStages() const {
+        lock_guard lock(mutex);
+        return stages;
+    }
+
+    vector<NodeRecord> Registry::getNodes() const {
+        lock_guard lock(mutex);
+        return nodes;
+    }
+
+    map<string, double> Registry::getValues() const {
+        lock_guard lock(mutex);
+        return values;
+    }
+
+    void Registry::writeJSON(ostream &os) const {
+        lock_guard lock(mutex);
+        os << setprecision(9);
+        os << "{" << endl << "  \"stages\": [" << endl;
+        for (unsigned int i = 0; i < stages.size(); i++) {
+            const auto &s = stages[i];
+            os << "    {\"name\": " << jsonString(s.name) << ", \"wall_time\": " << s.wallTime << ", \"cpu_time\": " << s.cpuTime
+               << ", \"peak_rss_kib\": " << s.peakRSS << "}" << (i+1 < stages.size() ? "," : "") << endl;
+        }
+        os << "  ]," << endl << "  \"values\": {";
+        for (auto it = values.begin(); it != values.end(); it++) {
+            os << (it == values.begin() ? "" : ",") << endl << "    " << jsonString(it->first) << ": " << it->second;
+        }
+        os << endl << "  }," << endl << "  \"nodes\": [" << endl;
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            const auto &n = nodes[i];
+            os << "    {\"sequence\": " << n.sequence << ", \"operation\": " << jsonString(n.operation) << ", \"vertex\": " << n.vertex
+               << ", \"bag_size\": " << n.bagSize << ", \"active_patterns\": " << n.activePatterns
+               << ", \"vars_added\": " << n.varsAdded << ", \"constrs_added\": " << n.constrsAdded << ", \"time\": " << n.time
+               << "}" << (i+1 < nodes.size() ? "," : "") << endl;
+        }
+        os << "  ]" << endl << "}" << endl;
+    }
+
+    void Registry::writeCSV(const filesystem::path &prefix) const {
+        lock_guard lock(mutex);
+        auto file = [&](const string &suffix) {
+            ofstream out(prefix.string()+suffix);
+            out << setprecision(9);
+            return out;
+        };
+        auto stagesFile = file("-stages.csv");
+        stagesFile << "name,wall_time,cpu_time,peak_rss_kib" << endl;
+        for (const auto &s : stages) {
+            stagesFile << s.name << "," << s.wallTime << "," << s.cpuTime << "," << s.peakRSS << endl;
+        }
+        auto valuesFile = file("-values.csv");
+        valuesFile << "name,value" << endl;
+        for (const auto &[name, value] : values) {
+            valuesFile << name << "," << value << endl;
+        }
+        auto nodesFile = file("-nodes.csv");
+        nodesFile << "sequence,operation,vertex,bag_size,active_patterns,vars_added,constrs_added,time" << endl;
+        for (const auto &n : nodes) {
+            nodesFile << n.sequence << "," << n.operation << "," << n.vertex << "," << n.bagSize << "," << n.activePatterns << ","
+                      << n.varsAdded << "," << n.constrsAdded << "," << n.time << endl;
+        }
+    }
+
+    double processCPUTime() {
+#if defined(__unix__) || defined(__APPLE__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_utime.tv_sec+usage.ru_stime.tv_sec+(usage.ru_utime.tv_usec+usage.ru_stime.tv_usec)*1e-6;
+#else
+        return (double)std::clock()/CLOCKS_PER_SEC;
+#endif
+    }
+
+    long peakRSS() {
+#if defined(__APPLE__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss/1024; // bytes on macOS
+#elif defined(__unix__)
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+#else
+        return 0;
+#endif
+    }
+
+    StageTimer::StageTimer(Registry *registry, string name) : registry(registry), name(std::move(name)), wallStart(wallTime()), cpuStart(processCPUTime()) {}
+
+    StageTimer::~StageTimer() {
+        stop();
+    }
+
+    void StageTimer::stop() {
+        if (!running)
+            return;
+        running = false;
+        if (registry != nullptr)
+            registry->addStage({name, wallTime()-wallStart, processCPUTime()-cpuStart, peakRSS()});
+    }
+}
@@ -0,0 +1,81 @@
+
+#ifndef LINEPLANNING_METRICS_H
+#define LINEPLANNING_METRICS_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <filesystem>
+#include <ostream>
+
+/*
+ * Structured metrics of a solve: per-stage times and memory, per-node records of the model construction and named values.
+ * A Registry may be shared between threads.
+ */
+namespace Metrics {
+
+    // times in seconds, memory in KiB
+    struct StageRecord {
+        std::string name;
+        double wallTime = 0;
+        double cpuTime = 0; // of the whole process, i.e. summed over all threads
+        long peakRSS = 0; // of the process at the end of the stage
+    };
+
+    // one operation of the nice tree decomposition traversal
+    struct NodeRecord {
+        unsigned int sequence = 0;
+        std::string operation; // introduce, forget or merge
+        int vertex = -1; // -1 for merge
+        unsigned int bagSize = 0;
+        size_t activePatterns = 0; // patterns with a nonzero count expression after the operation
+        unsigned long long varsAdded = 0;
+        unsigned long long constrsAdded = 0;
+        double time = 0;
+    };
+
+    class Registry {
+        mutable std::mutex mutex;
+        std::vector<StageRecord> stages;
+        std::vector<NodeRecord> nodes;
+        std::map<std::string, double> values;
+
+    public:
+        void addStage(StageRecord record);
+        void addNode(NodeRecord record);
+        void setValue(const std::string &name, double value);
+        void addToValue(const std::string &name, double value);
+        void clear();
+
+        std::vector<StageRecord> getStages() const;
+        std::vector<NodeRecord> getNodes() const;
+        std::map<std::string, double> getValues() const;
+
+        void writeJSON(std::ostream &os) const;
+        // writes <prefix>-stages.csv, <prefix>-nodes.csv and <prefix>-values.csv
+        void writeCSV(const std::filesystem::path &prefix) const;
+    };
+
+    // s as a quoted JSON string, line breaks become spaces
+    std::string jsonString(const std::string &s);
+
+    double processCPUTime();
+    long peakRSS();
+
+    // records a stage from construction until stop() or destruction, does nothing without a registry
+    class StageTimer {
+        Registry *registry;
+        std::string name;
+        double wallStart, cpuStart;
+        bool running = true;
+
+    public:
+        StageTimer(Registry *registry, std::string name);
+        StageTimer(const StageTimer&) = delete;
+        ~StageTimer();
+        void stop();
+    };
+}
+
+#endif //LINEPLANNING_METRICS_H
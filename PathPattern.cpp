@@ -102,12 +102,15 @@ namespace LinePlanning {
                     PathPattern pp1 = *this;
                     PathPattern pp2 = *this;
                     PathPattern pp3 = *this;
+                    PathPattern pp4 = *this; // v inside the forgotten part, with forgotten vertices on both sides
                     pp1.pat[i] = v;
                     pp2.pat.insert(pp2.pat.begin()+i, v);
                     pp3.pat.insert(pp3.pat.begin()+i+1, v);
+                    pp4.pat.insert(pp4.pat.begin()+i+1, {v, wildcard});
                     vec.push_back(pp1);
                     vec.push_back(pp2);
                     vec.push_back(pp3);
+                    vec.push_back(pp4);
                 }
             }
             return vec;
@@ -4,6 +4,7 @@
 #define LINEPLANNING_PATHPATTERN_H
 
 #include <vector>
+#include <algorithm>
 #include <set>
 #include <iostream>
 
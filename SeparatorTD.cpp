@@ -0,0 +1,342 @@
+
+#include "SeparatorTD.h"
+#include "SpecializedTD.h"
+#include <unordered_set>
+#include <algorithm>
+#include <queue>
+#include <future>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace std;
+
+
+namespace TreeDecomposition {
+
+    namespace {
+
+        // bags with parent indices, the root is the last bag
+        struct BagTree {
+            vector<set<Vertex>> bags;
+            vector<int> parents;
+
+            void attachChild(BagTree &&child, int rootIndex) {
+                int offset = bags.size();
+                for (unsigned int i = 0; i < child.bags.size(); i++) {
+                    bags.push_back(std::move(child.bags[i]));
+                    parents.push_back(child.parents[i] < 0 ? rootIndex : child.parents[i]+offset);
+                }
+            }
+        };
+
+        class SeparatorDecomposer {
+            unordered_map<Vertex, vector<Vertex>> adjacency;
+            Coordinates position;
+            SeparatorOptions options;
+            std::atomic<bool> exactSolverAvailable = true;
+            std::atomic<unsigned int> tmpFileCounter = 0;
+            std::atomic<int> spareThreads; // besides the calling thread
+            std::string tmpFilePrefix;
+
+            bool acquireThread() {
+                int a = spareThreads.load();
+                while (a > 0) {
+                    if (spareThreads.compare_exchange_weak(a, a-1))
+                        return true;
+                }
+                return false;
+            }
+
+        public:
+            SeparatorDecomposer(const WeightedIndexedGraph<void> &graph, Coordinates position, SeparatorOptions options)
+                : position(std::move(position)), options(options) {
+                unsigned int threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+                spareThreads = threads-1;
+                // isolated stops get an empty list, adjacency.at is used for every vertex
+                for (auto [index, _] : graph.nodes) {
+                    adjacency[index];
+                }
+                for (auto [_, e] : graph.edges) {
+                    adjacency[e->leftNode->index].push_back(e->rightNode->index);
+                    adjacency[e->rightNode->index].push_back(e->leftNode->index);
+                }
+                tmpFilePrefix = "lptw-separator-"+to_string(std::chrono::steady_clock::now().time_since_epoch().count())+"-";
+            }
+
+            // decomposition of the subgraph induced by piece, the root bag contains boundary
+            BagTree decompose(const vector<Vertex> &piece, const set<Vertex> &boundary) {
+                if (piece.size() <= options.leafSize)
+                    return leaf(piece, boundary);
+
+                unordered_set<Vertex> inPiece(piece.begin(), piece.end());
+                vector<Vertex> inner;
+                std::copy_if(piece.begin(), piece.end(), std::back_inserter(inner), [&](Vertex v) {return !boundary.contains(v);});
+                if (inner.size() < 2)
+                    return leaf(piece, boundary);
+
+                // split the inner vertices at the median of the wider extent
+                double minX = numeric_limits<double>::infinity(), maxX = -minX, minY = minX, maxY = -minX;
+                for (auto v : inner) {
+                    auto [x, y] = position.at(v);
+                    minX = min(minX, x);
+                    maxX = max(maxX, x);
+                    minY = min(minY, y);
+                    maxY = max(maxY, y);
+                }
+                bool splitX = maxX-minX >= maxY-minY;
+                auto coordinate = [&](Vertex v) {return splitX ? position.at(v).first : position.at(v).second;};
+                std::sort(inner.begin(), inner.end(), [&](Vertex v1, Vertex v2) {
+                    return std::make_pair(coordinate(v1), v1) < std::make_pair(coordinate(v2), v2);
+                });
+                unordered_set<Vertex> lowerHalf(inner.begin(), inner.begin()+inner.size()/2);
+
+                // separator: greedy vertex cover of the edges crossing the median
+                vector<pair<Vertex, Vertex>> cutEdges;
+                for (auto v : inner) {
+                    for (auto nb : adjacency.at(v)) {
+                        if (v < nb && inPiece.contains(nb) && !boundary.contains(nb) && lowerHalf.contains(v) != lowerHalf.contains(nb))
+                            cutEdges.push_back({v, nb});
+                    }
+                }
+                set<Vertex> rootBag = boundary;
+                while (!cutEdges.empty()) {
+                    unordered_map<Vertex, unsigned int> cutDegree;
+                    for (auto [u, v] : cutEdges) {
+                        cutDegree[u]++;
+                        cutDegree[v]++;
+                    }
+                    auto best = std::max_element(cutDegree.begin(), cutDegree.end(), [](const auto &a, const auto &b) {
+                        return a.second != b.second ? a.second < b.second : a.first > b.first;
+                    })->first;
+                    rootBag.insert(best);
+                    std::erase_if(cutEdges, [&](const pair<Vertex, Vertex> &e) {return e.first == best || e.second == best;});
+                }
+
+                // every component of the remaining vertices becomes a child piece, together with its neighbors in the root bag
+                vector<pair<vector<Vertex>, set<Vertex>>> childPieces;
+                unordered_set<Vertex> visited;
+                for (auto start : piece) {
+                    if (rootBag.contains(start) || visited.contains(start))
+                        continue;
+                    vector<Vertex> component = {start};
+                    set<Vertex> neighborsInRoot;
+                    visited.insert(start);
+                    for (unsigned int i = 0; i < component.size(); i++) {
+                        for (auto nb : adjacency.at(component[i])) {
+                            if (!inPiece.contains(nb))
+                                continue;
+                            if (rootBag.contains(nb)) {
+                                neighborsInRoot.insert(nb);
+                            } else if (!visited.contains(nb)) {
+                                visited.insert(nb);
+                                component.push_back(nb);
+                            }
+                        }
+                    }
+                    component.insert(component.end(), neighborsInRoot.begin(), neighborsInRoot.end());
+                    if (component.size() == piece.size())
+                        return leaf(piece, boundary); // no progress
+                    childPieces.push_back({std::move(component), std::move(neighborsInRoot)});
+                }
+
+                // large pieces go to a spare thread if there is one, so that at most options.threads pieces (and exact
+                // solver runs) are processed at once; the order of the children does not depend on it
+                vector<std::future<BagTree>> futures(childPieces.size());
+                vector<BagTree> children(childPieces.size());
+                for (unsigned int i = 0; i < childPieces.size(); i++) {
+                    const auto &[childPiece, childBoundary] = childPieces[i];
+                    if (childPiece.size() >= options.parallelSize && acquireThread()) {
+                        futures[i] = std::async(std::launch::async, [&piece = childPieces[i], this]() {
+                            struct Release {
+                                std::atomic<int> &spare;
+                                ~Release() {spare++;}
+                            } release{spareThreads};
+                            return decompose(piece.first, piece.second);
+                        });
+                    } else {
+                        children[i] = decompose(childPiece, childBoundary);
+                    }
+                }
+                for (unsigned int i = 0; i < childPieces.size(); i++) {
+                    if (futures[i].valid())
+                        children[i] = futures[i].get();
+                }
+
+                unsigned int bagCount = 1;
+                for (auto &child : children) {
+                    bagCount += child.bags.size();
+                }
+                BagTree result;
+                for (auto &child : children) {
+                    result.attachChild(std::move(child), bagCount-1);
+                }
+                result.bags.push_back(rootBag);
+                result.parents.push_back(-1);
+                return result;
+            }
+
+        private:
+            BagTree leaf(const vector<Vertex> &piece, const set<Vertex> &boundary) {
+                if (exactSolverAvailable) {
+                    try {
+                        return byExactSolver(piece, boundary);
+                    } catch (std::runtime_error &e) {
+                        if (exactSolverAvailable.exchange(false))
+                            std::cerr << e.what() << ", using min-degree elimination for the remaining pieces" << std::endl;
+                    }
+                }
+                return byElimination(piece, boundary);
+            }
+
+            // the edges of the piece, plus a clique on the boundary to force it into one bag
+            vector<pair<Vertex, Vertex>> leafEdges(const vector<Vertex> &piece, const set<Vertex> &boundary) const {
+                unordered_set<Vertex> inPiece(piece.begin(), piece.end());
+                vector<pair<Vertex, Vertex>> edges;
+                for (auto v : piece) {
+                    for (auto nb : adjacency.at(v)) {
+                        if (v < nb && inPiece.contains(nb) && !(boundary.contains(v) && boundary.contains(nb)))
+                            edges.push_back({v, nb});
+                    }
+                }
+                for (auto i = boundary.begin(); i != boundary.end(); i++) {
+                    for (auto j = std::next(i); j != boundary.end(); j++) {
+                        edges.push_back({*i, *j});
+                    }
+                }
+                return edges;
+            }
+
+            BagTree byExactSolver(const vector<Vertex> &piece, const set<Vertex> &boundary) {
+                EdgeListGraph graph;
+                set<Vertex> vertices;
+                for (auto [u, v] : leafEdges(piece, boundary)) {
+                    graph.addEdge({u, v});
+                    vertices.insert(u);
+                    vertices.insert(v);
+                }
+                graph.vertexCount = vertices.size();
+                if (graph.edges.empty())
+                    return {{set<Vertex>(piece.begin(), piece.end())}, {-1}};
+
+                auto tmpFile = filesystem::temp_directory_path() / (tmpFilePrefix+to_string(tmpFileCounter++)+".td");
+                auto td = computeWithPaces(graph, tmpFile, "1g");
+                filesystem::remove(tmpFile);
+
+                // re-root at a bag containing the boundary
+                const auto &bags = td.getBags();
+                unsigned int root = 0;
+                while (root < bags.size() && !std::includes(bags[root].vertices.begin(), bags[root].vertices.end(), boundary.begin(), boundary.end()))
+                    root++;
+                if (root == bags.size())
+                    throw std::runtime_error("exact tree decomposition of a piece has no bag containing its boundary");
+                vector<const Bag*> order = {&bags[root]};
+                unordered_map<const Bag*, const Bag*> parentOf = {{&bags[root], nullptr}};
+                for (unsigned int i = 0; i < order.size(); i++) {
+                    vector<const Bag*> neighbors(order[i]->children.begin(), order[i]->children.end());
+                    if (order[i]->parent != nullptr)
+                        neighbors.push_back(order[i]->parent);
+                    for (auto nb : neighbors) {
+                        if (!parentOf.contains(nb)) {
+                            parentOf[nb] = order[i];
+                            order.push_back(nb);
+                        }
+                    }
+                }
+                std::reverse(order.begin(), order.end());
+                unordered_map<const Bag*, int> index;
+                for (unsigned int i = 0; i < order.size(); i++) {
+                    index[order[i]] = i;
+                }
+                BagTree result;
+                for (auto bag : order) {
+                    result.bags.push_back(bag->vertices);
+                    result.parents.push_back(parentOf[bag] == nullptr ? -1 : index[parentOf[bag]]);
+                }
+                // vertices without edges in the piece
+                for (auto v : piece) {
+                    if (!vertices.contains(v))
+                        result.bags.back().insert(v);
+                }
+                return result;
+            }
+
+            BagTree byElimination(const vector<Vertex> &piece, const set<Vertex> &boundary) {
+                unordered_map<Vertex, set<Vertex>> neighbors;
+                for (auto v : piece) {
+                    neighbors[v];
+                }
+                for (auto [u, v] : leafEdges(piece, boundary)) {
+                    neighbors[u].insert(v);
+                    neighbors[v].insert(u);
+                }
+                // eliminate the inner vertices by minimum degree, the boundary remains as root bag
+                set<pair<size_t, Vertex>> queue;
+                for (auto v : piece) {
+                    if (!boundary.contains(v))
+                        queue.insert({neighbors[v].size(), v});
+                }
+                auto updateDegree = [&](Vertex v, auto change) {
+                    if (boundary.contains(v)) {
+                        change();
+                        return;
+                    }
+                    queue.erase({neighbors[v].size(), v});
+                    change();
+                    queue.insert({neighbors[v].size(), v});
+                };
+                vector<Vertex> eliminated;
+                vector<set<Vertex>> bags;
+                while (!queue.empty()) {
+                    Vertex v = queue.begin()->second;
+                    queue.erase(queue.begin());
+                    set<Vertex> bag = neighbors[v];
+                    for (auto a : bag) {
+                        updateDegree(a, [&]() {
+                            neighbors[a].erase(v);
+                            for (auto b : bag) {
+                                if (b != a)
+                                    neighbors[a].insert(b);
+                            }
+                        });
+                    }
+                    bag.insert(v);
+                    eliminated.push_back(v);
+                    bags.push_back(std::move(bag));
+                }
+
+                unordered_map<Vertex, int> eliminationIndex;
+                for (unsigned int i = 0; i < eliminated.size(); i++) {
+                    eliminationIndex[eliminated[i]] = i;
+                }
+                BagTree result;
+                int root = bags.size();
+                for (unsigned int i = 0; i < bags.size(); i++) {
+                    // parent: the bag of the neighbor eliminated next
+                    int parent = root;
+                    for (auto u : bags[i]) {
+                        auto it = eliminationIndex.find(u);
+                        if (u != eliminated[i] && it != eliminationIndex.end())
+                            parent = min(parent, it->second);
+                    }
+                    result.bags.push_back(std::move(bags[i]));
+                    result.parents.push_back(parent);
+                }
+                result.bags.push_back(boundary);
+                result.parents.push_back(-1);
+                return result;
+            }
+        };
+    }
+
+    TreeDecomposition bySeparators(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates, SeparatorOptions options) {
+        SeparatorDecomposer decomposer(graph, completeCoordinates(graph, coordinates), options);
+        vector<Vertex> vertices;
+        for (auto [index, _] : graph.nodes) {
+            vertices.push_back(index);
+        }
+        std::sort(vertices.begin(), vertices.end());
+        auto tree = decomposer.decompose(vertices, {});
+        return TreeDecomposition::fromTree(tree.bags, tree.parents);
+    }
+}
@@ -0,0 +1,24 @@
+
+#ifndef LINEPLANNING_SEPARATORTD_H
+#define LINEPLANNING_SEPARATORTD_H
+
+#include "Graph.h"
+#include "TreeDecomposition.h"
+
+
+namespace TreeDecomposition {
+
+    struct SeparatorOptions {
+        unsigned int leafSize = 100; // pieces up to this size are decomposed by the PACE exact solver
+        unsigned int parallelSize = 50; // pieces of at least this size are decomposed in their own thread while one is spare
+        unsigned int threads = 0; // threads decomposing pieces at once, 0 for one per hardware thread. Each runs its own JVM for the exact solver
+    };
+
+    // recursively splits the graph along median lines of the coordinates,
+    // the separators are vertex covers of the cut edges, small pieces are decomposed exactly
+    // (if the exact solver is not available, by min-degree elimination)
+    TreeDecomposition bySeparators(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates, SeparatorOptions options = {});
+}
+
+
+#endif //LINEPLANNING_SEPARATORTD_H
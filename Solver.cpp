@@ -1,6 +1,8 @@
 
 #include "Solver.h"
 #include <memory>
+#include <cstring>
+#include <cmath>
 #include "Combinatorics.h"
 
 /*#define THREADING
@@ -16,18 +18,22 @@ namespace LinePlanning {
         class LazyCostVector_Empty : public LazyCostVector{
 
         public:
-            LazyCostVector_Empty() : LazyCostVector(nullptr) {}
+            LazyCostVector_Empty(PatternIds *patternIds, TaskBudget *tasks) : LazyCostVector(nullptr, patternIds, tasks) {}
 
-            pair<ValueType,bool> compute_cost(const PathScheme &pathScheme) override {
+            pair<StateValue,bool> compute_cost(const PathScheme &pathScheme) override {
                 if (pathScheme.isZero())
                 {
-                    return {make_shared<AugmentedCost>(0), true};
+                    return {{0}, true};
                 }
                 else
                 {
-                    return {make_shared<AugmentedCost>(AugmentedCost::infinity()), true};
+                    return {{infinity}, true};
                 }
             }
+
+            shared_ptr<AugmentedCost> reconstruct(const PathScheme &pathScheme, const StateValue &value) override {
+                throw runtime_error("leaf states are never stored");
+            }
         };
 
         class LazyCostVector_Introduce : public LazyCostVector{
@@ -36,13 +42,12 @@ namespace LinePlanning {
             shared_ptr<LazyCostVector> cost_child;
 
         public:
-            LazyCostVector_Introduce(const Instance *instance, int v, shared_ptr<LazyCostVector> costChild)
-                    : LazyCostVector(instance), v(v), cost_child(costChild) {}
+            LazyCostVector_Introduce(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks, int v, shared_ptr<LazyCostVector> costChild)
+                    : LazyCostVector(instance, patternIds, tasks), v(v), cost_child(costChild) {}
 
-            pair<ValueType,bool> compute_cost(const PathScheme &pathScheme) override {
-                cost_t costTransforms = 0;
-                vector<BuildInstruction> transformations;
-                PathScheme newPS;
+        private:
+            // the instructions that build pathScheme from the child scheme newPS, false if pathScheme is forbidden
+            bool transform(const PathScheme &pathScheme, vector<BuildInstruction> &transformations, PathScheme &newPS, cost_t &costTransforms) const {
                 for (const auto &ps_it : pathScheme.data())
                 {
                     auto pp = PathPattern{ps_it.first.someRepresentantion()};
@@ -51,7 +56,7 @@ namespace LinePlanning {
                     {
                         if (!pp.incidentEdgesAreInsideBag(vi))
                         {
-                            return {make_shared<AugmentedCost>(AugmentedCost::infinity()), true}; //this is forbidden
+                            return false; //this is forbidden
                         }
                         else if (!pp.containsWildcard()) //all edges contained in bag
                         {
@@ -86,12 +91,155 @@ namespace LinePlanning {
                         newPS.add(pp, ps_it.second);
                     }
                 }
-                auto r_child = cost_child->operator[](newPS);
-                auto r = make_shared<AugmentedCost>(r_child);
-                r->cost += costTransforms;
+                return true;
+            }
+
+        public:
+            pair<StateValue,bool> compute_cost(const PathScheme &pathScheme) override {
+                cost_t costTransforms = 0;
+                vector<BuildInstruction> transformations;
+                PathScheme newPS;
+                if (!transform(pathScheme, transformations, newPS, costTransforms))
+                {
+                    return {{infinity}, true};
+                }
+                auto child = cost_child->operator[](newPS);
+                return {{child.cost+costTransforms, child.state}, false};
+            }
+
+            shared_ptr<AugmentedCost> reconstruct(const PathScheme &pathScheme, const StateValue &value) override {
+                cost_t costTransforms = 0;
+                vector<BuildInstruction> transformations;
+                PathScheme newPS;
+                transform(pathScheme, transformations, newPS, costTransforms);
+                auto r = make_shared<AugmentedCost>(cost_child->reconstruct(value.child1));
+                r->cost = value.cost;
                 r->instructions = std::move(transformations);
                 r->bagChange = BagChange{BagChange::ADD, v};
-                return {r, false};
+                return r;
+            }
+        };
+
+        // the child lookups of one DP state, a candidate costs fixed plus the values of its schemes in the child tables.
+        // They are evaluated in order, or in a concurrent run in batches split over the spare threads; either way the
+        // result is the first candidate of least cost, so that all runs agree exactly.
+        class CandidateLookups {
+            struct Candidate {
+                size_t begin1, begin2, end2; // of the scheme words
+                uint64_t hash1, hash2;
+                cost_t fixed, bound1, bound2;
+            };
+            static constexpr size_t batchSize = 1024, minChunk = 128;
+
+            LazyCostVector *child1, *child2;
+            TaskBudget *tasks;
+            vector<uint64_t> words;
+            vector<Candidate> batch;
+            StateValue best{std::numeric_limits<cost_t>::infinity()};
+            std::atomic<cost_t> bestCost{std::numeric_limits<cost_t>::infinity()}; // of all evaluated candidates, for pruning
+
+            void evaluate(const Candidate &c, std::span<const uint64_t> scheme1, std::span<const uint64_t> scheme2, StateValue &local)
+            {
+                if (child1->dominated(c.fixed+c.bound1+c.bound2, incumbent()))
+                    return;
+                auto c1 = child1->lookup(scheme1, c.hash1);
+                if (child1->dominated(c.fixed+c1.cost+c.bound2, incumbent()))
+                    return;
+                LazyCostVector::Lookup c2{0, StateValue::none};
+                if (child2 != nullptr)
+                    c2 = child2->lookup(scheme2, c.hash2);
+                cost_t cost = c1.cost+c2.cost+c.fixed;
+                if (cost < local.cost)
+                {
+                    local = StateValue{cost, c1.state, c2.state};
+                    cost_t current = bestCost.load();
+                    while (cost < current && !bestCost.compare_exchange_weak(current, cost));
+                }
+            }
+
+            // the best candidate of batch[begin, end)
+            StateValue evaluate(size_t begin, size_t end)
+            {
+                StateValue local{std::numeric_limits<cost_t>::infinity()};
+                for (size_t i = begin; i < end; i++)
+                {
+                    const auto &c = batch[i];
+                    evaluate(c, {words.data()+c.begin1, words.data()+c.begin2}, {words.data()+c.begin2, words.data()+c.end2}, local);
+                }
+                return local;
+            }
+
+            void flush()
+            {
+                unsigned int chunks = 1;
+                while (chunks < batch.size()/minChunk && tasks->tryAcquire())
+                    chunks++;
+                size_t chunkSize = (batch.size()+chunks-1)/chunks;
+                vector<future<StateValue>> futures;
+                for (unsigned int c = 1; c < chunks; c++)
+                {
+                    futures.push_back(std::async(std::launch::async, [&, c]() {
+                        auto local = evaluate(c*chunkSize, std::min(batch.size(), (c+1)*chunkSize));
+                        tasks->release();
+                        return local;
+                    }));
+                }
+                //merged in the order of the candidates, so that ties go to the first one as in a sequential run
+                auto local = evaluate(0, std::min(batch.size(), chunkSize));
+                if (local.cost < best.cost)
+                    best = local;
+                for (auto &f : futures)
+                {
+                    local = f.get();
+                    if (local.cost < best.cost)
+                        best = local;
+                }
+                batch.clear();
+                words.clear();
+            }
+
+        public:
+            // child2 is nullptr for candidates with a single scheme
+            CandidateLookups(LazyCostVector *child1, LazyCostVector *child2, TaskBudget *tasks) : child1(child1), child2(child2), tasks(tasks) {}
+
+            // the least cost found so far
+            cost_t incumbent() const
+            {
+                return bestCost.load(std::memory_order_relaxed);
+            }
+
+            void add(cost_t fixed, const SchemeBuilder &scheme1, const SchemeBuilder *scheme2 = nullptr)
+            {
+                Candidate c{0, 0, 0, scheme1.hash(), 0, fixed, scheme1.lowerBound(), 0};
+                if (scheme2 != nullptr)
+                {
+                    c.hash2 = scheme2->hash();
+                    c.bound2 = scheme2->lowerBound();
+                }
+                if (tasks == nullptr)
+                {
+                    std::span<const uint64_t> words2;
+                    if (scheme2 != nullptr)
+                        words2 = scheme2->scheme();
+                    evaluate(c, scheme1.scheme(), words2, best);
+                    return;
+                }
+                c.begin1 = words.size();
+                words.insert(words.end(), scheme1.scheme().begin(), scheme1.scheme().end());
+                c.begin2 = words.size();
+                if (scheme2 != nullptr)
+                    words.insert(words.end(), scheme2->scheme().begin(), scheme2->scheme().end());
+                c.end2 = words.size();
+                batch.push_back(c);
+                if (batch.size() >= batchSize)
+                    flush();
+            }
+
+            StateValue result()
+            {
+                if (!batch.empty())
+                    flush();
+                return best;
             }
         };
 
@@ -102,8 +250,8 @@ namespace LinePlanning {
             shared_ptr<LazyCostVector> cost_child;
 
         public:
-            LazyCostVector_forget(const Instance *instance, const set<int> &B_t, int v, shared_ptr<LazyCostVector> costChild)
-                    : LazyCostVector(instance), B_t(B_t), v(v), cost_child(costChild) {
+            LazyCostVector_forget(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks, const set<int> &B_t, int v, shared_ptr<LazyCostVector> costChild)
+                    : LazyCostVector(instance, patternIds, tasks), B_t(B_t), v(v), cost_child(costChild) {
 
             }
 
@@ -132,98 +280,145 @@ namespace LinePlanning {
         public:
 
 
-            pair<ValueType,bool> compute_cost(const PathScheme &pathScheme) override {
+            pair<StateValue,bool> compute_cost(const PathScheme &pathScheme) override {
                 using Edge = InstanceGraph::Edge;
                 using PPT = ReverseSymmetricVector<int>;
 
-                Combinatorics::SequenceOfChoices<PPT> choices;
-                for (const auto &it : pathScheme.data())
+                //the counters of a choice: the forgotten edges to B_t and the vertices of the child patterns
+                vector<Edge*> edges;
+                unordered_map<Edge*, unsigned int> edgeIndex;
+                for (int u : B_t)
                 {
-                    vector<PPT> choices_tmp = {it.first};
-                    auto unrep = PathPattern{it.first.someRepresentantion()}.unReplace(v);
-                    for (const auto &pp : unrep)
+                    Edge* e = instance->graph.findEdge(u, v);
+                    if (e != nullptr)
                     {
-                        if (!hasForbiddenEdge(pp))
-                        {
-                            auto ppt = PPT{pp.toVector()};
-                            choices_tmp.push_back(ppt);
-                        }
+                        edgeIndex[e] = edges.size();
+                        edges.push_back(e);
                     }
-                    choices.choose(std::move(choices_tmp), it.second);
                 }
+                vector<int> vertices{v};
+                unordered_map<int, unsigned int> vertexIndex{{v, 0}};
 
-                auto bestChild = make_shared<AugmentedCost>(AugmentedCost::infinity());
-                for (auto choice : choices)
-                {
-                    PathScheme ps_child0;
-                    unordered_map<Edge*, unsigned int> forgottenEdgeCount;
-                    unordered_map<int, unsigned int> vertexFmaxCount;
-                    for (auto &cv : choice)
+                // a child pattern with what one unit of it adds to the counters
+                struct Option {
+                    uint32_t id;
+                    vector<pair<unsigned int, unsigned int>> edgeCounts, vertexCounts;
+                };
+                auto makeOption = [&](const PathPattern &pp) {
+                    Option opt{patternIds->id(PPT{pp.toVector()})};
+                    map<unsigned int, unsigned int> edgeCounts, vertexCounts;
+                    for (auto ed : pp.edges())
                     {
-                        for (auto &p : cv)
+                        if (ed.first != PathPattern::wildcard && ed.second != PathPattern::wildcard && (ed.first == v || ed.second == v))
                         {
-                            ps_child0.add(p.first, p.second);
-                            PathPattern pp(p.first.someRepresentantion());
-                            for (auto ed : pp.edges())
-                            {
-                                if (ed.first != PathPattern::wildcard && ed.second != PathPattern::wildcard && (ed.first == v || ed.second == v))
-                                {
-                                    Edge* e = instance->graph.findEdge(ed.first, ed.second);
-                                    if (e != nullptr)
-                                        forgottenEdgeCount[e] += p.second;
-                                }
-                                if (ed.first != PathPattern::wildcard)
-                                    vertexFmaxCount[ed.first] += p.second;
-                                if (ed.second != PathPattern::wildcard)
-                                    vertexFmaxCount[ed.second] += p.second;
-                            }
+                            auto it = edgeIndex.find(instance->graph.findEdge(ed.first, ed.second));
+                            if (it != edgeIndex.end())
+                                edgeCounts[it->second]++;
                         }
-                    }
-                    bool valid = true;
-
-                    for (int u : B_t)
-                    {
-                        Edge* e = instance->graph.findEdge(u, v);
-                        if (e != nullptr)
+                        for (int u : {ed.first, ed.second})
                         {
-                            if (!(forgottenEdgeCount[e] >= e->weight.f_min && forgottenEdgeCount[e] <= e->weight.f_max))
+                            if (u != PathPattern::wildcard)
                             {
-                                valid = false;
-                                break;
+                                auto [it, inserted] = vertexIndex.try_emplace(u, vertices.size());
+                                if (inserted)
+                                    vertices.push_back(u);
+                                vertexCounts[it->second]++;
                             }
                         }
                     }
-                    if (!valid)
-                        continue;
+                    opt.edgeCounts.assign(edgeCounts.begin(), edgeCounts.end());
+                    opt.vertexCounts.assign(vertexCounts.begin(), vertexCounts.end());
+                    return opt;
+                };
 
-                    for (auto p : vertexFmaxCount)
+                Combinatorics::SequenceOfChoices<Option> choices;
+                vector<unsigned int> stageCounts;
+                for (const auto &it : pathScheme.data())
+                {
+                    PathPattern pp{it.first.someRepresentantion()};
+                    vector<Option> choices_tmp = {makeOption(pp)};
+                    for (const auto &unrep : pp.unReplace(v))
                     {
-                        if (p.second > instance->getTotalFmax(p.first))
-                        {
-                            valid = false;
-                            break;
-                        }
+                        if (!hasForbiddenEdge(unrep))
+                            choices_tmp.push_back(makeOption(unrep));
                     }
-                    if (!valid)
-                        continue;
+                    choices.choose(std::move(choices_tmp), it.second);
+                    stageCounts.push_back(it.second);
+                }
 
-                    unsigned int v_allowance = instance->getTotalFmax(v) - vertexFmaxCount[v];
-                    auto extra_pat1 = PPT{{v, PathPattern::wildcard}};
-                    auto extra_pat2 = PPT{{PathPattern::wildcard, v, PathPattern::wildcard}};
-                    for (unsigned int i1 = 0; i1 <= v_allowance; i1++)
+                //the counters follow the moves of the Gray walk, together with the number of violated constraints
+                vector<unsigned int> edgeCount(edges.size(), 0), vertexCount(vertices.size(), 0);
+                vector<unsigned int> vertexFmax(vertices.size());
+                for (unsigned int i = 0; i < vertices.size(); i++)
+                    vertexFmax[i] = instance->getTotalFmax(vertices[i]);
+                auto edgeViolated = [&](unsigned int i) {
+                    return edgeCount[i] < edges[i]->weight.f_min || edgeCount[i] > edges[i]->weight.f_max;
+                };
+                int violations = 0;
+                for (unsigned int i = 0; i < edges.size(); i++)
+                    violations += edgeViolated(i);
+
+                SchemeBuilder scheme(patternIds);
+                auto apply = [&](const Option &opt, int times) {
+                    scheme.add(opt.id, times);
+                    for (auto [i, c] : opt.edgeCounts)
                     {
-                        for (unsigned int i2 = 0; i1+2*i2 <= v_allowance; i2++)
+                        bool before = edgeViolated(i);
+                        edgeCount[i] += times*(int)c;
+                        violations += (int)edgeViolated(i)-before;
+                    }
+                    for (auto [i, c] : opt.vertexCounts)
+                    {
+                        bool before = vertexCount[i] > vertexFmax[i];
+                        vertexCount[i] += times*(int)c;
+                        violations += (int)(vertexCount[i] > vertexFmax[i])-before;
+                    }
+                };
+                for (unsigned int s = 0; s < choices.size(); s++)
+                    apply(choices.option(s, 0), stageCounts[s]);
+
+                auto extra_pat1 = patternIds->id(PPT{{v, PathPattern::wildcard}});
+                auto extra_pat2 = patternIds->id(PPT{{PathPattern::wildcard, v, PathPattern::wildcard}});
+                CandidateLookups candidates(cost_child.get(), nullptr, tasks);
+                auto walk = choices.walk();
+                Combinatorics::SequenceOfChoices<Option>::Move move;
+                while (true)
+                {
+                    if (violations == 0)
+                    {
+                        unsigned int v_allowance = vertexFmax[0] - vertexCount[0];
+                        auto saved1 = scheme.count(extra_pat1), saved2 = scheme.count(extra_pat2);
+                        //the bound grows with i1 and i2, so the remaining candidates of a loop are dominated as well
+                        for (unsigned int i1 = 0; i1 <= v_allowance; i1++)
                         {
-                            ps_child0.assign(extra_pat1, i1);
-                            ps_child0.assign(extra_pat2, i2);
-                            bestChild = std::min(bestChild, cost_child->operator[](ps_child0), [](auto p1, auto p2){return *p1 < *p2;});
+                            scheme.set(extra_pat1, i1);
+                            scheme.set(extra_pat2, 0);
+                            if (dominated(scheme.lowerBound(), candidates.incumbent()))
+                                break;
+                            for (unsigned int i2 = 0; i1+2*i2 <= v_allowance; i2++)
+                            {
+                                scheme.set(extra_pat2, i2);
+                                if (dominated(scheme.lowerBound(), candidates.incumbent()))
+                                    break;
+                                candidates.add(0, scheme);
+                            }
                         }
+                        scheme.set(extra_pat1, saved1);
+                        scheme.set(extra_pat2, saved2);
                     }
-
+                    if (!walk.next(move))
+                        break;
+                    apply(choices.option(move.stage, move.from), -1);
+                    apply(choices.option(move.stage, move.to), 1);
                 }
-                auto result = make_shared<AugmentedCost>(bestChild);
+                return {candidates.result(), false};
+            }
+
+            shared_ptr<AugmentedCost> reconstruct(const PathScheme &pathScheme, const StateValue &value) override {
+                auto result = make_shared<AugmentedCost>(cost_child->reconstruct(value.child1));
+                result->cost = value.cost;
                 result->bagChange = BagChange{BagChange::REMOVE, v};
-                return {result, false};
+                return result;
             }
 
             /*pair<ValueType,bool> compute_cost_old(const PathScheme &pathScheme)  {
@@ -330,32 +525,41 @@ namespace LinePlanning {
             shared_ptr<LazyCostVector> child1, child2;
         public:
 
-            LazyCostVector_Join(const Instance *instance, const shared_ptr<LazyCostVector> &child1,
-                                const shared_ptr<LazyCostVector> &child2) : LazyCostVector(instance), child1(child1),
+            LazyCostVector_Join(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks, const shared_ptr<LazyCostVector> &child1,
+                                const shared_ptr<LazyCostVector> &child2) : LazyCostVector(instance, patternIds, tasks), child1(child1),
                                                                             child2(child2) {}
 
-            pair<ValueType,bool> compute_cost(const PathScheme &pathScheme) override {
-
-                struct Option{
-                    enum {LEFT,RIGHT,MERGE} mode;
-                    PathPattern left,right;
-                };
-
+        private:
+            struct Option{
+                enum {LEFT,RIGHT,MERGE} mode;
+                PathPattern left,right;
+                uint32_t leftId = 0, rightId = 0;
+                cost_t cost = 0; //of merging one unit
+            };
+
+            // calls f(scheme1, scheme2, transform_costs, makeTransforms) for every way to build pathScheme from the
+            // children, the schemes and costs are updated by the moves of a Gray walk over the choices
+            template <class F>
+            void forEachChoice(const PathScheme &pathScheme, F f) {
                 Combinatorics::SequenceOfChoices<Option> choices;
+                vector<unsigned int> stageCounts;
                 for (auto it : pathScheme.data())
                 {
                     PathPattern pp = it.first.someRepresentantion();
+                    uint32_t id = patternIds->id(it.first);
                     vector<Option> options;
                     {
                         Option opt;
                         opt.mode = Option::LEFT;
                         opt.left = pp;
+                        opt.leftId = id;
                         options.push_back(opt);
                     }
                     {
                         Option opt;
                         opt.mode = Option::RIGHT;
                         opt.right = pp;
+                        opt.rightId = id;
                         options.push_back(opt);
                     }
                     auto pp_splits = pp.allNontrivialSplits();
@@ -365,50 +569,95 @@ namespace LinePlanning {
                         opt.mode = Option::MERGE;
                         opt.left = sp.first;
                         opt.right = sp.second;
+                        opt.leftId = patternIds->id(ReverseSymmetricVector<int>{sp.first.toVector()});
+                        opt.rightId = patternIds->id(ReverseSymmetricVector<int>{sp.second.toVector()});
+                        opt.cost = mergeInstruction(opt, 1).computeCost(instance);
                         options.push_back(opt);
                     }
                     choices.choose(std::move(options), it.second);
+                    stageCounts.push_back(it.second);
                 }
 
-                auto optimum = make_shared<AugmentedCost>(AugmentedCost::infinity());
-                for (vector<vector<pair<Option,unsigned int>>> choice : choices)
+                SchemeBuilder scheme1(patternIds), scheme2(patternIds);
+                cost_t transform_costs = 0;
+                vector<vector<unsigned int>> choice(choices.size());
+                auto apply = [&](unsigned int stage, unsigned int i, int times) {
+                    const Option &opt = choices.option(stage, i);
+                    choice[stage][i] += times;
+                    if (opt.mode != Option::RIGHT)
+                        scheme1.add(opt.leftId, times);
+                    if (opt.mode != Option::LEFT)
+                        scheme2.add(opt.rightId, times);
+                    transform_costs += times*opt.cost;
+                };
+                for (unsigned int s = 0; s < choices.size(); s++)
                 {
-                    PathScheme ps_child1;
-                    PathScheme ps_child2;
+                    choice[s].assign(choices.optionCount(s), 0);
+                    apply(s, 0, stageCounts[s]);
+                }
+                auto makeTransforms = [&]() {
                     vector<BuildInstruction> transforms;
-                    cost_t transform_costs = 0;
-                    for (auto const& v : choice)
+                    for (unsigned int s = 0; s < choices.size(); s++)
                     {
-                        for (auto const& p : v)
+                        for (unsigned int i = 0; i < choice[s].size(); i++)
                         {
-                            switch (p.first.mode)
-                            {
-                                case Option::LEFT:
-                                    ps_child1.add(p.first.left, p.second);
-                                    break;
-                                case Option::RIGHT:
-                                    ps_child2.add(p.first.right, p.second);
-                                    break;
-                                case Option::MERGE:
-                                    ps_child1.add(p.first.left, p.second);
-                                    ps_child2.add(p.first.right, p.second);
-                                    BuildInstruction transform;
-                                    transform.mode = BuildInstruction::MERGE;
-                                    transform.initial = p.first.left;
-                                    transform.initial2 = p.first.right;
-                                    transform.frequency = p.second;
-                                    transform_costs += transform.computeCost(instance);
-                                    transforms.push_back(std::move(transform));
-                                    break;
-                            }
+                            if (choice[s][i] > 0 && choices.option(s, i).mode == Option::MERGE)
+                                transforms.push_back(mergeInstruction(choices.option(s, i), choice[s][i]));
                         }
                     }
-                    auto cc = make_shared<AugmentedCost>(child1->operator[](ps_child1), child2->operator[](ps_child2));
-                    cc->cost += transform_costs;
-                    cc->instructions = std::move(transforms);
-                    optimum = std::min(optimum, cc, [](auto p1, auto p2){return *p1 < *p2;});
+                    return transforms;
+                };
+
+                auto walk = choices.walk();
+                Combinatorics::SequenceOfChoices<Option>::Move move;
+                while (true)
+                {
+                    f(scheme1, scheme2, transform_costs, makeTransforms);
+                    if (!walk.next(move))
+                        break;
+                    apply(move.stage, move.from, -1);
+                    apply(move.stage, move.to, 1);
                 }
-                return {optimum, false};
+            }
+
+            static BuildInstruction mergeInstruction(const Option &opt, unsigned int frequency) {
+                BuildInstruction transform;
+                transform.mode = BuildInstruction::MERGE;
+                transform.initial = opt.left;
+                transform.initial2 = opt.right;
+                transform.frequency = frequency;
+                return transform;
+            }
+
+        public:
+            pair<StateValue,bool> compute_cost(const PathScheme &pathScheme) override {
+                CandidateLookups candidates(child1.get(), child2.get(), tasks);
+                forEachChoice(pathScheme, [&](const SchemeBuilder &scheme1, const SchemeBuilder &scheme2, cost_t transform_costs, auto &){
+                    candidates.add(transform_costs, scheme1, &scheme2);
+                });
+                return {candidates.result(), false};
+            }
+
+            // the merges are not stored: among the choices leading to the stored child states, any one with the least merge costs is optimal
+            shared_ptr<AugmentedCost> reconstruct(const PathScheme &pathScheme, const StateValue &value) override {
+                vector<BuildInstruction> bestTransforms;
+                cost_t bestCosts = infinity;
+                forEachChoice(pathScheme, [&](const SchemeBuilder &scheme1, const SchemeBuilder &scheme2, cost_t transform_costs, auto &makeTransforms){
+                    if (transform_costs >= bestCosts)
+                        return;
+                    //choices pruned by compute_cost are skipped here as well, their child states may not exist
+                    if (dominated(transform_costs+scheme1.lowerBound()+scheme2.lowerBound(), value.cost))
+                        return;
+                    if (child1->operator[](scheme1).state == value.child1 && child2->operator[](scheme2).state == value.child2)
+                    {
+                        bestCosts = transform_costs;
+                        bestTransforms = makeTransforms();
+                    }
+                });
+                auto r = make_shared<AugmentedCost>(child1->reconstruct(value.child1), child2->reconstruct(value.child2));
+                r->cost = value.cost;
+                r->instructions = std::move(bestTransforms);
+                return r;
             }
         };
 
@@ -417,38 +666,39 @@ namespace LinePlanning {
             set<int> vertices;
             shared_ptr<LazyCostVector> cost_current;
             const Instance* instance;
+            PatternIds* patternIds;
+            TaskBudget* tasks;
 
-            NiceVisitor(const Instance *instance, const shared_ptr<LazyCostVector> &costCurrent) : cost_current(costCurrent),
-                                                                                             instance(instance) {}
+            NiceVisitor(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks, const shared_ptr<LazyCostVector> &costCurrent)
+                    : cost_current(costCurrent), instance(instance), patternIds(patternIds), tasks(tasks) {}
 
             void introduce(int v){
-                cost_current = make_shared<LazyCostVector_Introduce>(instance, v, cost_current);
-                std::cout << "introduce node: " << vertices.size() << "+1" << endl;
+                cost_current = make_shared<LazyCostVector_Introduce>(instance, patternIds, tasks, v, cost_current);
                 vertices.insert(v);
             }
             void forget(int v){
-                std::cout << "forget node: " << vertices.size() << "-1" << endl;
                 vertices.erase(v);
-                cost_current = make_shared<LazyCostVector_forget>(instance, vertices, v, cost_current);
+                cost_current = make_shared<LazyCostVector_forget>(instance, patternIds, tasks, vertices, v, cost_current);
             }
 
             void merge(const NiceVisitor &other)
             {
-                std::cout << "join node: " << vertices.size() << endl;
-                cost_current = make_shared<LazyCostVector_Join>(instance, cost_current, other.cost_current);
+                cost_current = make_shared<LazyCostVector_Join>(instance, patternIds, tasks, cost_current, other.cost_current);
             }
         };
 
-        shared_ptr<AugmentedCost> solve(const Instance &instance, const TreeDecomposition::TreeDecomposition &td) {
-            NiceVisitor leafVisitor(&instance, make_shared<LazyCostVector_Empty>());
-            NiceVisitor visitorFinished = td.niceVisit<NiceVisitor>(leafVisitor);
-            auto res = visitorFinished.cost_current->operator[](PathScheme{});
-            return res;
-        }
-
-        shared_ptr<AugmentedCost> solve(const Instance &instance) {
-            TreeDecomposition::TreeDecomposition td = TreeDecomposition::compute(TreeDecomposition::convert(instance.graph));
-            return solve(instance, td);
+        shared_ptr<AugmentedCost> solve(const Instance &instance, const TreeDecomposition::TreeDecomposition &td, unsigned int threads, int maxGaps) {
+            PatternIds patternIds(&instance, maxGaps);
+            TaskBudget budget(threads);
+            TaskBudget *tasks = threads > 1 ? &budget : nullptr;
+            NiceVisitor visitorFinished = td.niceVisit([&](){
+                return NiceVisitor(&instance, &patternIds, tasks, make_shared<LazyCostVector_Empty>(&patternIds, tasks));
+            });
+            auto root = visitorFinished.cost_current;
+            auto optimum = root->operator[](PathScheme{});
+            if (std::isinf(optimum.cost))
+                return make_shared<AugmentedCost>(AugmentedCost::infinity());
+            return root->reconstruct(optimum.state);
         }
 
 
@@ -746,6 +996,215 @@ namespace LinePlanning {
             return os;
         }
 
-        LazyCostVector::LazyCostVector(const Instance *instance) : instance(instance) {}
+        FlatScheme PathScheme::flatten(PatternIds &patternIds) const {
+            FlatScheme scheme;
+            scheme.reserve(_counts.size());
+            for (const auto &[pp, count] : _counts)
+            {
+                if (count != 0)
+                    scheme.push_back((uint64_t)patternIds.id(pp) << 32 | count);
+            }
+            std::sort(scheme.begin(), scheme.end());
+            return scheme;
+        }
+
+        PathScheme PathScheme::unflatten(std::span<const uint64_t> scheme, const PatternIds &patternIds) {
+            PathScheme ps;
+            for (auto w : scheme)
+            {
+                ps._counts.emplace_hint(ps._counts.end(), patternIds.pattern(w >> 32), (unsigned int)w);
+            }
+            return ps;
+        }
+
+        size_t PatternIds::Hash::operator()(const PPT &pp) const {
+            size_t h = pp.someRepresentantion().size();
+            for (int v : pp.someRepresentantion())
+            {
+                h = h*0x9e3779b97f4a7c15ull + (unsigned int)v;
+            }
+            return h ^ (h >> 29);
+        }
+
+        PatternIds::PatternIds(const Instance *instance, int maxGaps) : instance(instance), maxGaps(maxGaps) {
+            boundsValid = instance->c_fix >= 0;
+            for (const auto& [_, e] : instance->graph.edges)
+            {
+                boundsValid = boundsValid && e->weight.cost >= 0;
+            }
+        }
+
+        uint32_t PatternIds::id(const PPT &pp) {
+            std::lock_guard lock(mutex);
+            auto [it, inserted] = ids.try_emplace(pp, (uint32_t)ids.size());
+            if (inserted)
+            {
+                uint32_t id = it->second;
+                if ((id >> blockBits) >= maxBlocks)
+                    throw runtime_error("too many path patterns");
+                auto &block = blocks[id >> blockBits];
+                if (block == nullptr)
+                    block = std::make_unique<Entry[]>(1u << blockBits);
+                //every line using the pattern pays c_fix and these edges, and the rest of its cost is non-negative: edges
+                //of forgotten vertices stay paid and the join refund only cancels cost charged twice. This needs
+                //c_fix >= 0 and non-negative edge costs, otherwise canPrune() turns the pruning off.
+                cost_t bound = instance->c_fix;
+                const auto &pat = pp.someRepresentantion();
+                for (unsigned int i = 0; i+1 < pat.size(); i++)
+                {
+                    if (pat[i] != PathPattern::wildcard && pat[i+1] != PathPattern::wildcard)
+                        bound += instance->edgeCost(pat[i], pat[i+1]);
+                }
+                int gaps = pat.size() < 3 ? 0 : (int)std::count(pat.begin()+1, pat.end()-1, PathPattern::wildcard);
+                block[id & ((1u << blockBits)-1)] = Entry{pp, bound, maxGaps < 0 || gaps <= maxGaps};
+            }
+            return it->second;
+        }
+
+        uint64_t SchemeTable::hash(std::span<const uint64_t> scheme) {
+            uint64_t h = 0;
+            for (auto w : scheme)
+            {
+                h += wordHash(w);
+            }
+            return h;
+        }
+
+        uint64_t SchemeTable::wordHash(uint64_t word) {
+            //splitmix64 finalizer, the slot is taken from the low bits of the sum
+            uint64_t h = word + 0x9e3779b97f4a7c15ull;
+            h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+            h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+            return h ^ (h >> 31);
+        }
+
+        unsigned int SchemeBuilder::count(uint32_t patternId) const {
+            uint64_t key = (uint64_t)patternId << 32;
+            auto it = std::lower_bound(words.begin(), words.end(), key);
+            if (it != words.end() && (*it >> 32) == patternId)
+                return (uint32_t)*it;
+            return 0;
+        }
+
+        void SchemeBuilder::set(uint32_t patternId, unsigned int count) {
+            uint64_t key = (uint64_t)patternId << 32;
+            auto it = std::lower_bound(words.begin(), words.end(), key);
+            unsigned int old = 0;
+            if (it != words.end() && (*it >> 32) == patternId)
+                old = (uint32_t)*it;
+            if (old == count)
+                return;
+            if (old != 0)
+                _hash -= SchemeTable::wordHash(*it);
+            bound += ((cost_t)count-old)*patternIds->lowerBound(patternId);
+            if (count == 0)
+                words.erase(it);
+            else
+            {
+                if (old == 0)
+                    it = words.insert(it, key | count);
+                else
+                    *it = key | count;
+                _hash += SchemeTable::wordHash(*it);
+            }
+        }
+
+        uint32_t SchemeTable::find(std::span<const uint64_t> scheme, uint64_t hash) const {
+            if (slots.empty())
+                return notFound;
+            size_t mask = slots.size()-1;
+            for (size_t i = hash & mask; slots[i] != 0; i = (i+1) & mask)
+            {
+                auto s = slots[i]-1;
+                auto stored = state(s);
+                if (hashes[s] == hash && stored.size() == scheme.size()
+                    && std::memcmp(stored.data(), scheme.data(), scheme.size_bytes()) == 0)
+                    return s;
+            }
+            return notFound;
+        }
+
+        uint32_t SchemeTable::insert(std::span<const uint64_t> scheme, uint64_t hash) {
+            if (2*(size()+1) > slots.size())
+                grow();
+            uint32_t s = size();
+            words.insert(words.end(), scheme.begin(), scheme.end());
+            offsets.push_back(words.size());
+            hashes.push_back(hash);
+            size_t mask = slots.size()-1;
+            size_t i = hash & mask;
+            while (slots[i] != 0)
+                i = (i+1) & mask;
+            slots[i] = s+1;
+            return s;
+        }
+
+        void SchemeTable::grow() {
+            slots.assign(std::max<size_t>(16, 2*slots.size()), 0);
+            size_t mask = slots.size()-1;
+            for (uint32_t s = 0; s < size(); s++)
+            {
+                size_t i = hashes[s] & mask;
+                while (slots[i] != 0)
+                    i = (i+1) & mask;
+                slots[i] = s+1;
+            }
+        }
+
+        LazyCostVector::LazyCostVector(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks)
+                : instance(instance), patternIds(patternIds), tasks(tasks) {}
+
+        LazyCostVector::Lookup LazyCostVector::lookup(std::span<const uint64_t> scheme, uint64_t hash) {
+            //states with a pattern outside the admissible family are left out, like forbidden ones
+            for (auto w : scheme)
+            {
+                if (!patternIds->admissible(w >> 32))
+                    return {infinity, StateValue::none};
+            }
+            if (tasks == nullptr)
+            {
+                auto i = states.find(scheme, hash);
+                if (i != SchemeTable::notFound)
+                {
+                    return {values[i].cost, i};
+                }
+                auto [val, isTrivial] = compute_cost(PathScheme::unflatten(scheme, *patternIds));
+                if (isTrivial) //optimization: don't store trivial values
+                {
+                    return {val.cost, StateValue::none};
+                }
+                values.push_back(val);
+                return {val.cost, states.insert(scheme, hash)};
+            }
+
+            //concurrent run: the state is reserved before it is computed, other threads wait for its future
+            std::unique_lock lock(mutex);
+            auto i = states.find(scheme, hash);
+            if (i != SchemeTable::notFound)
+            {
+                auto it = pending.find(i);
+                if (it == pending.end())
+                    return {values[i].cost, values[i].child1 == StateValue::trivial ? StateValue::none : i};
+                auto future = it->second;
+                lock.unlock();
+                return future.get();
+            }
+            i = states.insert(scheme, hash);
+            values.emplace_back();
+            std::promise<Lookup> promise;
+            pending.emplace(i, promise.get_future().share());
+            lock.unlock();
+
+            auto [val, isTrivial] = compute_cost(PathScheme::unflatten(scheme, *patternIds));
+            if (isTrivial)
+                val.child1 = StateValue::trivial;
+            Lookup result{val.cost, isTrivial ? StateValue::none : i};
+            lock.lock();
+            values[i] = val;
+            pending.erase(i);
+            lock.unlock();
+            promise.set_value(result);
+            return result;
+        }
     }
 }
\ No newline at end of file
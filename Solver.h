@@ -5,44 +5,109 @@
 
 
 #include "SolverLib.h"
+#include <atomic>
+#include <future>
 
 
 namespace LinePlanning {
     namespace Solver {
 
+        // memoised value of a DP state: its cost and the states of the child tables it was computed from
+        struct StateValue {
+            static constexpr uint32_t none = -1; // trivial child state (not stored), or no child
+            static constexpr uint32_t trivial = -2; // in child1: a trivial state that was stored by a concurrent run
+
+            cost_t cost;
+            uint32_t child1 = none, child2 = none;
+        };
+
+        // the threads that a DP run may start in addition to the calling one, shared by all of its tables
+        class TaskBudget {
+            std::atomic<int> available;
+        public:
+            explicit TaskBudget(unsigned int threads) : available(threads-1) {}
+
+            bool tryAcquire()
+            {
+                int a = available.load();
+                while (a > 0)
+                {
+                    if (available.compare_exchange_weak(a, a-1))
+                        return true;
+                }
+                return false;
+            }
+
+            void release()
+            {
+                available++;
+            }
+        };
+
         class LazyCostVector {
+        public:
+            struct Lookup {
+                cost_t cost;
+                uint32_t state; // StateValue::none if the value is trivial
+            };
+
         protected:
-            typedef shared_ptr<AugmentedCost> ValueType;
-            map<PathScheme, ValueType> cost_stored;
+            SchemeTable states;
+            vector<StateValue> values; // by state index
             static constexpr cost_t infinity = std::numeric_limits<cost_t>::infinity();
             const Instance* instance;
+            PatternIds* patternIds;
+            TaskBudget* tasks; // nullptr for a sequential run
 
-            virtual pair<ValueType,bool> compute_cost(const PathScheme &pathScheme) = 0;
+            // for concurrent runs: guards states and values, a state in pending is being computed by another thread
+            std::mutex mutex;
+            unordered_map<uint32_t, std::shared_future<Lookup>> pending;
+
+            virtual pair<StateValue,bool> compute_cost(const PathScheme &pathScheme) = 0;
+            // the build steps of a stored state, regenerated only for the states of the optimum
+            virtual shared_ptr<AugmentedCost> reconstruct(const PathScheme &pathScheme, const StateValue &value) = 0;
 
         public:
-            LazyCostVector(const Instance *instance);
+            // whether a candidate with this lower bound cannot beat the incumbent, with slack for rounding in the bound
+            bool dominated(cost_t bound, cost_t incumbent) const
+            {
+                return patternIds->canPrune() && bound > incumbent + 1e-9*(1+std::abs(incumbent));
+            }
+
+            LazyCostVector(const Instance *instance, PatternIds *patternIds, TaskBudget *tasks);
+            virtual ~LazyCostVector() = default;
 
-            ValueType operator[](const PathScheme &pathScheme)
+            Lookup operator[](const PathScheme &pathScheme)
             {
-                auto it = cost_stored.find(pathScheme);
-                if (it == cost_stored.end())
-                {
-                    auto [val, isTrivial] = compute_cost(pathScheme);
-                    if (isTrivial) //optimization: don't store trivial values
-                    {
-                        return val;
-                    }
-                    else
-                    {
-                        it = cost_stored.insert(it, make_pair(pathScheme, val));
-                    }
-                }
-                return it->second;
+                return operator[](pathScheme.flatten(*patternIds));
+            }
+
+            Lookup operator[](const FlatScheme &scheme)
+            {
+                return lookup(scheme, SchemeTable::hash(scheme));
+            }
+
+            Lookup operator[](const SchemeBuilder &scheme)
+            {
+                return lookup(scheme.scheme(), scheme.hash());
+            }
+
+            // computes every state once, also if several threads ask for it
+            Lookup lookup(std::span<const uint64_t> scheme, uint64_t hash);
+
+            // the only trivial state with finite cost is the empty scheme of a leaf, it has no build steps
+            shared_ptr<AugmentedCost> reconstruct(uint32_t state)
+            {
+                if (state == StateValue::none)
+                    return make_shared<AugmentedCost>(0);
+                return reconstruct(PathScheme::unflatten(states.state(state), *patternIds), values[state]);
             }
         };
 
-        shared_ptr<AugmentedCost> solve(const Instance& instance, const TreeDecomposition::TreeDecomposition& td);
-        shared_ptr<AugmentedCost> solve(const Instance& instance);
+        // threads: 1 for a sequential run, the result does not depend on it.
+        // maxGaps >= 0 restricts the states to patterns with at most that many wildcards between their ends, so that the
+        // result is only optimal among the line concepts whose lines have such patterns at every node.
+        shared_ptr<AugmentedCost> solve(const Instance& instance, const TreeDecomposition::TreeDecomposition& td, unsigned int threads = 1, int maxGaps = -1);
     }
 }
 
@@ -9,6 +9,11 @@
 
 #include <map>
 #include <memory>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+#include <array>
+#include <mutex>
 
 
 namespace LinePlanning {
@@ -80,6 +85,143 @@ namespace LinePlanning {
 
         struct BuildInstruction;
 
+        // dense ids for the path patterns of one DP run, id() may be called concurrently
+        class PatternIds {
+            typedef ReverseSymmetricVector<int> PPT;
+
+            struct Hash {
+                size_t operator()(const PPT &pp) const;
+            };
+            struct Equal {
+                bool operator()(const PPT &pp1, const PPT &pp2) const {
+                    return pp1.someRepresentantion() == pp2.someRepresentantion();
+                }
+            };
+            struct Entry {
+                PPT pattern;
+                cost_t bound;
+                bool admissible;
+            };
+            //entries never move, so that pattern() and lowerBound() need no lock
+            static constexpr unsigned int blockBits = 12, maxBlocks = 1 << 12;
+
+            const Instance *instance;
+            int maxGaps;
+            bool boundsValid; // see canPrune
+            unordered_map<PPT, uint32_t, Hash, Equal> ids;
+            std::array<std::unique_ptr<Entry[]>, maxBlocks> blocks;
+            std::mutex mutex;
+
+            const Entry& entry(uint32_t id) const
+            {
+                return blocks[id >> blockBits][id & ((1u << blockBits)-1)];
+            }
+        public:
+            // maxGaps: patterns with more wildcards between their ends are not admissible, negative for no limit
+            explicit PatternIds(const Instance *instance, int maxGaps = -1);
+
+            uint32_t id(const PPT &pp);
+
+            const PPT& pattern(uint32_t id) const
+            {
+                return entry(id).pattern;
+            }
+
+            // lower bound on the cost of one occurrence of the pattern in a DP state: c_fix plus its edges between bag vertices
+            cost_t lowerBound(uint32_t id) const
+            {
+                return entry(id).bound;
+            }
+
+            // whether the lower bounds may be used to prune choices: only if c_fix and all edge costs are non-negative
+            bool canPrune() const
+            {
+                return boundsValid;
+            }
+
+            // whether states with the pattern are considered, see maxGaps
+            bool admissible(uint32_t id) const
+            {
+                return entry(id).admissible;
+            }
+
+            // lower bound on the DP value of a state
+            cost_t lowerBound(std::span<const uint64_t> scheme) const
+            {
+                cost_t bound = 0;
+                for (auto w : scheme)
+                {
+                    bound += (uint32_t)w*lowerBound(w >> 32);
+                }
+                return bound;
+            }
+        };
+
+        // a path scheme as the sorted words (pattern id << 32 | count) of its nonzero counts
+        typedef vector<uint64_t> FlatScheme;
+
+        // interned DP states: open addressing with linear probing, the words of all states in one array
+        class SchemeTable {
+            vector<uint64_t> words;
+            vector<uint32_t> offsets{0}; // state i has the words [offsets[i], offsets[i+1])
+            vector<uint64_t> hashes;
+            vector<uint32_t> slots; // state index + 1, 0 if empty
+
+            void grow();
+        public:
+            static constexpr uint32_t notFound = -1;
+
+            // the sum of the word hashes, so that it can follow changes of single counts
+            static uint64_t hash(std::span<const uint64_t> scheme);
+            static uint64_t wordHash(uint64_t word);
+
+            uint32_t find(std::span<const uint64_t> scheme, uint64_t hash) const;
+            // scheme must not be in the table yet, returns its state index
+            uint32_t insert(std::span<const uint64_t> scheme, uint64_t hash);
+
+            std::span<const uint64_t> state(uint32_t i) const
+            {
+                return {words.data()+offsets[i], words.data()+offsets[i+1]};
+            }
+
+            uint32_t size() const
+            {
+                return hashes.size();
+            }
+        };
+
+        // a flat scheme that is changed one count at a time, with its hash and lower bound kept up to date
+        class SchemeBuilder {
+            FlatScheme words;
+            uint64_t _hash = 0;
+            cost_t bound = 0;
+            const PatternIds *patternIds;
+        public:
+            explicit SchemeBuilder(const PatternIds *patternIds) : patternIds(patternIds) {}
+
+            unsigned int count(uint32_t patternId) const;
+            void set(uint32_t patternId, unsigned int count);
+            void add(uint32_t patternId, int delta)
+            {
+                set(patternId, count(patternId)+delta);
+            }
+
+            const FlatScheme& scheme() const
+            {
+                return words;
+            }
+
+            uint64_t hash() const
+            {
+                return _hash;
+            }
+
+            cost_t lowerBound() const
+            {
+                return bound;
+            }
+        };
+
         class PathScheme {
             typedef ReverseSymmetricVector<int> PPT;
             map<PPT, unsigned int> _counts;
@@ -123,6 +265,9 @@ namespace LinePlanning {
 
             LineConcept toLineConcept(const Instance *instance) const;
 
+            FlatScheme flatten(PatternIds &patternIds) const;
+            static PathScheme unflatten(std::span<const uint64_t> scheme, const PatternIds &patternIds);
+
             friend ostream& operator<<(ostream& os, PathScheme const& ps);
         };
 
@@ -2,6 +2,12 @@
 #include "SpecializedTD.h"
 #include <unordered_set>
 #include <algorithm>
+#include <queue>
+#include <numbers>
+#include <cmath>
+#include <optional>
+#include <tuple>
+#include <future>
 
 using namespace std;
 
@@ -316,4 +322,646 @@ namespace TreeDecomposition {
 
         throw WrongGraphClassError("not a ring graph");
     }
+
+
+    vector<set<Vertex>> pathDecompositionFromOrder(const WeightedIndexedGraph<void> &graph, const vector<Vertex> &order) {
+        unordered_map<Vertex, unsigned int> pos;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            pos[order[i]] = i;
+        }
+        vector<vector<Vertex>> forgetAfter(order.size());
+        for (unsigned int i = 0; i < order.size(); i++) {
+            unsigned int last = i;
+            for (auto nb : graph.nodes.at(order[i])->getNeighbors()) {
+                last = max(last, pos.at(nb->index));
+            }
+            forgetAfter[last].push_back(order[i]);
+        }
+        vector<set<Vertex>> bags;
+        set<Vertex> bag;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            bag.insert(order[i]);
+            // a bag after which nothing is forgotten is contained in the next one
+            if (!forgetAfter[i].empty() || i+1 == order.size()) {
+                bags.push_back(bag);
+            }
+            for (auto v : forgetAfter[i]) {
+                bag.erase(v);
+            }
+        }
+        return bags;
+    }
+
+    // BFS distances from source using the edges accepted by useEdge, throws if the graph is not connected this way
+    template <class EdgeFilter>
+    unordered_map<Node*, unsigned int> bfsDistances(const WeightedIndexedGraph<void> &graph, Node* source, EdgeFilter useEdge) {
+        unordered_map<Node*, unsigned int> dist;
+        std::queue<Node*> queue;
+        dist[source] = 0;
+        queue.push(source);
+        while (!queue.empty()) {
+            Node* n = queue.front();
+            queue.pop();
+            for (auto nb : n->getNeighbors()) {
+                if (!dist.contains(nb) && useEdge(n, nb)) {
+                    dist[nb] = dist[n]+1;
+                    queue.push(nb);
+                }
+            }
+        }
+        if (dist.size() != graph.nodes.size())
+            throw WrongGraphClassError("graph not connected");
+        return dist;
+    }
+
+    unordered_map<Node*, unsigned int> bfsDistances(const WeightedIndexedGraph<void> &graph, Node* source) {
+        return bfsDistances(graph, source, [](Node*, Node*) {return true;});
+    }
+
+    vector<vector<Node*>> levelsByDistance(const unordered_map<Node*, unsigned int> &dist) {
+        vector<vector<Node*>> levels;
+        for (auto [n, d] : dist) {
+            if (levels.size() <= d)
+                levels.resize(d+1);
+            levels[d].push_back(n);
+        }
+        for (auto &level : levels) {
+            std::sort(level.begin(), level.end(), [](Node* n1, Node* n2) {return n1->index < n2->index;});
+        }
+        return levels;
+    }
+
+    // evaluation of a vertex order w.r.t. a lattice embedding
+    struct NearClassCandidate {
+        vector<Vertex> order;
+        unsigned int idealBagSize = 0; // bag size if only the lattice edges were present
+        unsigned int bagSize = 0;
+        vector<Edge> deviatingEdges;
+        unsigned int missingEdges = 0;
+    };
+
+    // bag sizes of pathDecompositionFromOrder (one per introduced vertex) when only the edges accepted by isCounted are present
+    template <class EdgeFilter>
+    vector<unsigned int> bagSizesOfOrder(const vector<Node*> &order, EdgeFilter isCounted) {
+        unordered_map<Node*, unsigned int> pos;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            pos[order[i]] = i;
+        }
+        vector<int> delta(order.size()+1, 0);
+        for (unsigned int i = 0; i < order.size(); i++) {
+            unsigned int last = i;
+            for (auto nb : order[i]->getNeighbors()) {
+                if (isCounted(order[i], nb))
+                    last = max(last, pos.at(nb));
+            }
+            delta[i]++;
+            delta[last+1]--;
+        }
+        vector<unsigned int> sizes(order.size());
+        int alive = 0;
+        for (unsigned int i = 0; i < order.size(); i++) {
+            alive += delta[i];
+            sizes[i] = alive;
+        }
+        return sizes;
+    }
+
+    template <class EdgeFilter>
+    unsigned int largestBagOfOrder(const vector<Node*> &order, EdgeFilter isCounted) {
+        auto sizes = bagSizesOfOrder(order, isCounted);
+        return sizes.empty() ? 0 : *std::max_element(sizes.begin(), sizes.end());
+    }
+
+    template <class LatticeTest>
+    NearClassCandidate evaluateOrder(const vector<Node*> &order, LatticeTest isLattice, unsigned int missingEdges) {
+        NearClassCandidate c;
+        for (auto n : order) {
+            c.order.push_back(n->index);
+            for (auto nb : n->getNeighbors()) {
+                if (n->index < nb->index && !isLattice(n, nb))
+                    c.deviatingEdges.push_back({(Vertex)n->index, (Vertex)nb->index});
+            }
+        }
+        c.idealBagSize = largestBagOfOrder(order, isLattice);
+        c.bagSize = largestBagOfOrder(order, [](Node*, Node*) {return true;});
+        c.missingEdges = missingEdges;
+        return c;
+    }
+
+    bool isAcceptable(const NearClassCandidate &c, unsigned int edgeCount, const NearClassTolerance &tolerance) {
+        return c.deviatingEdges.size() + c.missingEdges <= tolerance.maxDeviationRatio * edgeCount
+            && c.bagSize <= c.idealBagSize + tolerance.maxExtraWidth;
+    }
+
+    TreeDecomposition buildNearClassTD(const WeightedIndexedGraph<void> &graph, NearClassCandidate &c, vector<Edge> *deviatingEdges) {
+        if (deviatingEdges != nullptr)
+            *deviatingEdges = std::move(c.deviatingEdges);
+        return TreeDecomposition::fromPathDecomposition(pathDecompositionFromOrder(graph, c.order));
+    }
+
+    TreeDecomposition forNearGrid(const WeightedIndexedGraph<void> &graph, vector<Edge> *deviatingEdges, NearClassTolerance tolerance) {
+        if (graph.nodes.size() < 4)
+            throw WrongGraphClassError("not a near-grid graph");
+
+        // a diagonal closes a triangle on both of its sides, a grid edge at most on one side (unless next to another diagonal)
+        // diagonals would shortcut the distances, so they are left out as long as the rest stays connected
+        set<pair<Node*, Node*>> diagonals;
+        for (auto [_, e] : graph.edges) {
+            if (commonNeighbors(e->leftNode, e->rightNode).size() >= 2) {
+                diagonals.insert({e->leftNode, e->rightNode});
+                diagonals.insert({e->rightNode, e->leftNode});
+            }
+        }
+        auto isGridCandidate = [&](Node* n1, Node* n2) {return !diagonals.contains({n1, n2});};
+
+        Node* start = nullptr;
+        for (auto [_, n] : graph.nodes) {
+            if (start == nullptr || n->index < start->index)
+                start = n;
+        }
+        try {
+            bfsDistances(graph, start, isGridCandidate);
+        } catch (WrongGraphClassError &ex) {
+            diagonals.clear();
+        }
+        auto farthest = [](const unordered_map<Node*, unsigned int> &dist) {
+            Node* result = nullptr;
+            auto key = [&](Node* m) {return std::make_tuple(-(int)dist.at(m), m->incidentEdges.size(), m->index);};
+            for (auto [n, _] : dist) {
+                if (result == nullptr || key(n) < key(result))
+                    result = n;
+            }
+            return result;
+        };
+
+        auto embedFromCorner = [&](Node* corner) {
+            // the BFS levels from the corner are the anti-diagonals of the grid,
+            // the vertices of a level are ordered by the mean rank of their neighbors in the previous level
+            auto levels = levelsByDistance(bfsDistances(graph, corner, isGridCandidate));
+            unordered_map<Node*, unsigned int> level, rank;
+            for (unsigned int l = 0; l < levels.size(); l++) {
+                if (l > 0) {
+                    unordered_map<Node*, double> key;
+                    for (auto n : levels[l]) {
+                        double sum = 0;
+                        unsigned int count = 0;
+                        for (auto nb : n->getNeighbors()) {
+                            if (level.contains(nb) && level[nb] == l-1) {
+                                sum += rank[nb];
+                                count++;
+                            }
+                        }
+                        key[n] = count > 0 ? sum/count : 0;
+                    }
+                    std::stable_sort(levels[l].begin(), levels[l].end(), [&](Node* n1, Node* n2) {return key[n1] < key[n2];});
+                }
+                for (unsigned int r = 0; r < levels[l].size(); r++) {
+                    level[levels[l][r]] = l;
+                    rank[levels[l][r]] = r;
+                }
+            }
+
+            auto isLattice = [&](Node* n1, Node* n2) {
+                return std::abs((int)level[n1]-(int)level[n2]) == 1 && std::abs((int)rank[n1]-(int)rank[n2]) <= 1;
+            };
+
+            // inner vertices of an anti-diagonal have two lattice neighbors in the previous one, its ends at least one
+            unsigned int missing = 0;
+            vector<Node*> order;
+            for (unsigned int l = 0; l < levels.size(); l++) {
+                for (unsigned int r = 0; r < levels[l].size(); r++) {
+                    Node* n = levels[l][r];
+                    order.push_back(n);
+                    if (l == 0)
+                        continue;
+                    unsigned int expected = (r == 0 || r+1 == levels[l].size()) ? 1 : 2;
+                    unsigned int found = 0;
+                    for (auto nb : n->getNeighbors()) {
+                        if (level[nb] == l-1 && isLattice(n, nb))
+                            found++;
+                    }
+                    missing += found < expected ? expected-found : 0;
+                }
+            }
+            return evaluateOrder(order, isLattice, missing);
+        };
+
+        // double sweep: a vertex farthest from an arbitrary start is a corner of the grid, the one farthest from it the opposite corner
+        // one of the remaining corners is farthest from a shortest path between these two, it gives the other diagonal direction
+        Node* cornerA = farthest(bfsDistances(graph, start, isGridCandidate));
+        auto distA = bfsDistances(graph, cornerA, isGridCandidate);
+        Node* cornerC = farthest(distA);
+        unordered_map<Node*, unsigned int> distPath;
+        for (Node* n = cornerC; n != cornerA; ) {
+            distPath[n] = 0;
+            for (auto nb : n->getNeighbors()) {
+                if (isGridCandidate(n, nb) && distA.at(nb)+1 == distA.at(n)) {
+                    n = nb;
+                    break;
+                }
+            }
+        }
+        distPath[cornerA] = 0;
+        {
+            std::queue<Node*> queue;
+            for (auto [n, _] : distPath) {
+                queue.push(n);
+            }
+            while (!queue.empty()) {
+                Node* n = queue.front();
+                queue.pop();
+                for (auto nb : n->getNeighbors()) {
+                    if (isGridCandidate(n, nb) && !distPath.contains(nb)) {
+                        distPath[nb] = distPath[n]+1;
+                        queue.push(nb);
+                    }
+                }
+            }
+        }
+        Node* cornerB = farthest(distPath);
+
+        std::optional<NearClassCandidate> best;
+        for (Node* corner : {cornerA, cornerB}) {
+            auto c = embedFromCorner(corner);
+            if (isAcceptable(c, graph.edges.size(), tolerance) && (!best || c.bagSize < best->bagSize))
+                best = std::move(c);
+        }
+        if (!best)
+            throw WrongGraphClassError("not a near-grid graph");
+        return buildNearClassTD(graph, *best, deviatingEdges);
+    }
+
+    TreeDecomposition forNearRings(const WeightedIndexedGraph<void> &graph, vector<Edge> *deviatingEdges, NearClassTolerance tolerance) {
+        constexpr double TWO_PI = 2*std::numbers::pi;
+        if (graph.nodes.size() < 4)
+            throw WrongGraphClassError("not a near-ring graph");
+
+        vector<Node*> nodesSorted;
+        for (auto [_, n] : graph.nodes) {
+            nodesSorted.push_back(n);
+        }
+        std::sort(nodesSorted.begin(), nodesSorted.end(), [](Node* n1, Node* n2) {
+            if (n1->incidentEdges.size() != n2->incidentEdges.size())
+                return n1->incidentEdges.size() > n2->incidentEdges.size();
+            return n1->index < n2->index;
+        });
+
+        std::optional<NearClassCandidate> best;
+        const unsigned int centerCandidates = 3;
+        for (unsigned int ci = 0; ci < min<size_t>(centerCandidates, nodesSorted.size()); ci++) {
+            Node* centerNode = nodesSorted[ci];
+            // ring r is the BFS level r+1 from the center
+            auto levels = levelsByDistance(bfsDistances(graph, centerNode));
+            if (levels.size() < 2 || levels[1].size() < 3)
+                continue;
+            unordered_map<Node*, unsigned int> level;
+            for (unsigned int l = 0; l < levels.size(); l++) {
+                for (auto n : levels[l]) {
+                    level[n] = l;
+                }
+            }
+
+            // angles of the innermost ring: walk along it, jump to the closest unvisited vertex where it is interrupted
+            unordered_map<Node*, double> angle;
+            {
+                vector<Node*> cycle;
+                Node* current = levels[1][0];
+                while (current != nullptr) {
+                    angle[current] = 0;
+                    cycle.push_back(current);
+                    Node* next = nullptr;
+                    for (auto nb : current->getNeighbors()) {
+                        if (level[nb] == 1 && !angle.contains(nb) && (next == nullptr || nb->index < next->index))
+                            next = nb;
+                    }
+                    if (next == nullptr && cycle.size() < levels[1].size()) {
+                        unordered_set<Node*> visited = {current};
+                        std::queue<Node*> queue;
+                        queue.push(current);
+                        while (!queue.empty() && next == nullptr) {
+                            Node* n = queue.front();
+                            queue.pop();
+                            for (auto nb : n->getNeighbors()) {
+                                if (level[nb] >= 1 && !visited.contains(nb)) {
+                                    if (level[nb] == 1 && !angle.contains(nb)) {
+                                        next = nb;
+                                        break;
+                                    }
+                                    visited.insert(nb);
+                                    queue.push(nb);
+                                }
+                            }
+                        }
+                        if (next == nullptr) {
+                            auto unvisited = unmarkedNodes(levels[1], angle);
+                            next = unvisited.front();
+                        }
+                    }
+                    current = next;
+                }
+                for (unsigned int i = 0; i < cycle.size(); i++) {
+                    angle[cycle[i]] = TWO_PI*i/cycle.size();
+                }
+            }
+            // outer rings: circular mean of the angles of the neighbors in the previous ring
+            for (unsigned int l = 2; l < levels.size(); l++) {
+                for (auto n : levels[l]) {
+                    double x = 0, y = 0, any = 0;
+                    for (auto nb : n->getNeighbors()) {
+                        if (level[nb] == l-1) {
+                            x += std::cos(angle[nb]);
+                            y += std::sin(angle[nb]);
+                            any = angle[nb];
+                        }
+                    }
+                    double a = (std::abs(x) < 1e-9 && std::abs(y) < 1e-9) ? any : std::atan2(y, x);
+                    angle[n] = a < 0 ? a+TWO_PI : a;
+                }
+            }
+            unordered_map<Node*, unsigned int> rank;
+            for (unsigned int l = 1; l < levels.size(); l++) {
+                std::stable_sort(levels[l].begin(), levels[l].end(), [&](Node* n1, Node* n2) {return angle[n1] < angle[n2];});
+                for (unsigned int r = 0; r < levels[l].size(); r++) {
+                    rank[levels[l][r]] = r;
+                }
+            }
+
+            auto angleDistance = [&](Node* n1, Node* n2) {
+                double d = std::abs(angle[n1]-angle[n2]);
+                return min(d, TWO_PI-d);
+            };
+            auto isLattice = [&](Node* n1, Node* n2) {
+                unsigned int l1 = level[n1], l2 = level[n2];
+                if (l1 == 0 || l2 == 0)
+                    return true;
+                if (l1 == l2) {
+                    unsigned int d = std::abs((int)rank[n1]-(int)rank[n2]);
+                    return d == 1 || d+1 == levels[l1].size();
+                }
+                return angleDistance(n1, n2) <= std::numbers::pi/levels[min(l1, l2)].size() + 1e-9;
+            };
+
+            // every ring vertex has two lattice neighbors on its ring and one on the previous ring
+            unsigned int missingOnRing = 0, missingInward = 0;
+            for (unsigned int l = 1; l < levels.size(); l++) {
+                for (auto n : levels[l]) {
+                    unsigned int onRing = 0, inward = 0;
+                    for (auto nb : n->getNeighbors()) {
+                        if (isLattice(n, nb)) {
+                            if (level[nb] == l)
+                                onRing++;
+                            else if (level[nb] == l-1)
+                                inward++;
+                        }
+                    }
+                    missingOnRing += onRing < 2 ? 2-onRing : 0;
+                    missingInward += (l >= 2 && inward == 0) ? 1 : 0;
+                }
+            }
+            unsigned int missing = missingOnRing/2 + missingInward;
+
+            // ring by ring, or spoke by spoke
+            vector<Node*> byRing = {centerNode};
+            for (unsigned int l = 1; l < levels.size(); l++) {
+                byRing.insert(byRing.end(), levels[l].begin(), levels[l].end());
+            }
+            vector<Node*> bySpoke(byRing.begin()+1, byRing.end());
+            std::stable_sort(bySpoke.begin(), bySpoke.end(), [&](Node* n1, Node* n2) {
+                return std::make_pair(angle[n1], level[n1]) < std::make_pair(angle[n2], level[n2]);
+            });
+            bySpoke.insert(bySpoke.begin(), centerNode);
+
+            for (auto &order : {byRing, bySpoke}) {
+                auto c = evaluateOrder(order, isLattice, missing);
+                if (isAcceptable(c, graph.edges.size(), tolerance) && (!best || c.bagSize < best->bagSize))
+                    best = std::move(c);
+            }
+        }
+
+        if (!best)
+            throw WrongGraphClassError("not a near-ring graph");
+        return buildNearClassTD(graph, *best, deviatingEdges);
+    }
+
+    // number of path patterns on k bag vertices: sequences of j distinct vertices with an optional square in each of the j+1 gaps,
+    // up to reversal (j = 1: (?v), (?v?)); the ILP has a few variables per pattern and bag
+    double pathPatternCount(unsigned int k) {
+        double count = 2*k;
+        double sequences = k;
+        for (unsigned int j = 2; j <= k; j++) {
+            sequences *= k-j+1;
+            count += sequences*std::pow(2., j);
+        }
+        return count;
+    }
+
+    Coordinates completeCoordinates(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates) {
+        typedef std::pair<double, double> Point;
+        Coordinates result;
+        Point centroid = {0, 0};
+        for (auto [index, _] : graph.nodes) {
+            auto it = coordinates.find(index);
+            if (it != coordinates.end()) {
+                result[index] = it->second;
+                centroid.first += it->second.first;
+                centroid.second += it->second.second;
+            }
+        }
+        if (result.empty())
+            throw WrongGraphClassError("no coordinates");
+        centroid.first /= result.size();
+        centroid.second /= result.size();
+        for (auto [index, n] : graph.nodes) {
+            if (coordinates.contains(index))
+                continue;
+            Point p = {0, 0};
+            unsigned int count = 0;
+            for (auto nb : n->getNeighbors()) {
+                auto it = coordinates.find(nb->index);
+                if (it != coordinates.end()) {
+                    p.first += it->second.first;
+                    p.second += it->second.second;
+                    count++;
+                }
+            }
+            result[index] = count > 0 ? Point{p.first/count, p.second/count} : centroid;
+        }
+        return result;
+    }
+
+    TreeDecomposition forCoordinates(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates, unsigned int directions) {
+        if (graph.nodes.empty() || directions == 0)
+            throw WrongGraphClassError("nothing to sweep");
+
+        unordered_map<Node*, std::pair<double, double>> position;
+        for (auto [index, p] : completeCoordinates(graph, coordinates)) {
+            position[graph.nodes.at(index)] = p;
+        }
+        std::pair<double, double> centroid = {0, 0};
+        for (auto [_, p] : position) {
+            centroid.first += p.first/position.size();
+            centroid.second += p.second/position.size();
+        }
+
+        // principal axis of the point cloud
+        double sxx = 0, syy = 0, sxy = 0;
+        for (auto [_, p] : position) {
+            double dx = p.first-centroid.first, dy = p.second-centroid.second;
+            sxx += dx*dx;
+            syy += dy*dy;
+            sxy += dx*dy;
+        }
+        double principalAngle = 0.5*std::atan2(2*sxy, sxx-syy);
+
+        struct Sweep {
+            vector<Node*> order;
+            unsigned int largestBag;
+            double predictedSize;
+        };
+        auto sweep = [&](double angle) {
+            double dx = std::cos(angle), dy = std::sin(angle);
+            Sweep result;
+            vector<std::pair<double, Node*>> projected;
+            for (auto [n, p] : position) {
+                projected.push_back({p.first*dx + p.second*dy, n});
+            }
+            std::sort(projected.begin(), projected.end(), [](const auto &a, const auto &b) {
+                return a.first != b.first ? a.first < b.first : a.second->index < b.second->index;
+            });
+            for (auto [_, n] : projected) {
+                result.order.push_back(n);
+            }
+            auto sizes = bagSizesOfOrder(result.order, [](Node*, Node*) {return true;});
+            result.largestBag = *std::max_element(sizes.begin(), sizes.end());
+            result.predictedSize = 0;
+            for (auto size : sizes) {
+                result.predictedSize += pathPatternCount(size);
+            }
+            return result;
+        };
+
+        // opposite directions give the same bags, so half a turn suffices
+        vector<std::future<Sweep>> futures;
+        for (unsigned int i = 0; i < directions; i++) {
+            futures.push_back(std::async(std::launch::async, sweep, principalAngle + std::numbers::pi*i/directions));
+        }
+        std::optional<Sweep> best;
+        for (auto &f : futures) {
+            Sweep s = f.get();
+            if (!best || std::make_pair(s.largestBag, s.predictedSize) < std::make_pair(best->largestBag, best->predictedSize))
+                best = std::move(s);
+        }
+
+        vector<Vertex> order;
+        for (auto n : best->order) {
+            order.push_back(n->index);
+        }
+        return TreeDecomposition::fromPathDecomposition(pathDecompositionFromOrder(graph, order));
+    }
+
+    // vertices in order of their first bag in a preorder of the tree decomposition, the largest subtree of each bag
+    // visited last, so that only the bags on the path to it stay open
+    vector<Node*> preorderOfDecomposition(const WeightedIndexedGraph<void> &graph, const TreeDecomposition &td) {
+        const Bag *root = td.root();
+        unordered_map<const Bag*, unsigned int> subtreeSize;
+        vector<const Bag*> stack = {root}, preorder;
+        while (!stack.empty()) {
+            const Bag *bag = stack.back();
+            stack.pop_back();
+            preorder.push_back(bag);
+            stack.insert(stack.end(), bag->children.begin(), bag->children.end());
+        }
+        for (auto it = preorder.rbegin(); it != preorder.rend(); it++) {
+            subtreeSize[*it] = 1;
+            for (auto child : (*it)->children) {
+                subtreeSize[*it] += subtreeSize[child];
+            }
+        }
+
+        vector<Node*> order;
+        unordered_set<Vertex> seen;
+        stack = {root};
+        while (!stack.empty()) {
+            const Bag *bag = stack.back();
+            stack.pop_back();
+            for (auto v : bag->vertices) {
+                if (seen.insert(v).second)
+                    order.push_back(graph.nodes.at(v));
+            }
+            vector<const Bag*> children(bag->children.begin(), bag->children.end());
+            std::stable_sort(children.begin(), children.end(), [&](const Bag *a, const Bag *b) {
+                return subtreeSize[a] > subtreeSize[b];
+            });
+            stack.insert(stack.end(), children.begin(), children.end());
+        }
+        return order;
+    }
+
+    // breadth-first order of every component, started at a vertex found by repeated searches for the farthest vertex
+    vector<Node*> breadthFirstOrder(const WeightedIndexedGraph<void> &graph) {
+        auto layers = [](Node *source, vector<Node*> &order) {
+            unordered_set<Node*> seen = {source};
+            order = {source};
+            for (size_t i = 0; i < order.size(); i++) {
+                auto neighbors = order[i]->getNeighbors();
+                std::sort(neighbors.begin(), neighbors.end(), [](Node *a, Node *b) {return a->index < b->index;});
+                for (auto nb : neighbors) {
+                    if (seen.insert(nb).second)
+                        order.push_back(nb);
+                }
+            }
+        };
+
+        vector<Node*> nodes;
+        for (auto [_, n] : graph.nodes) {
+            nodes.push_back(n);
+        }
+        std::sort(nodes.begin(), nodes.end(), [](Node *a, Node *b) {return a->index < b->index;});
+        vector<Node*> order;
+        unordered_set<Node*> done;
+        for (auto n : nodes) {
+            if (done.contains(n))
+                continue;
+            vector<Node*> component;
+            layers(n, component);
+            for (int sweep = 0; sweep < 2; sweep++) {
+                layers(component.back(), component);
+            }
+            done.insert(component.begin(), component.end());
+            order.insert(order.end(), component.begin(), component.end());
+        }
+        return order;
+    }
+
+    TreeDecomposition pathDecomposition(const WeightedIndexedGraph<void> &graph, const TreeDecomposition &td, const Coordinates *coordinates) {
+        if (graph.nodes.empty())
+            throw WrongGraphClassError("nothing to decompose");
+
+        vector<vector<Node*>> orders = {preorderOfDecomposition(graph, td), breadthFirstOrder(graph)};
+        std::optional<std::pair<unsigned int, double>> best;
+        vector<Node*> *bestOrder = nullptr;
+        for (auto &order : orders) {
+            auto sizes = bagSizesOfOrder(order, [](Node*, Node*) {return true;});
+            std::pair<unsigned int, double> score = {*std::max_element(sizes.begin(), sizes.end()), 0};
+            for (auto size : sizes) {
+                score.second += pathPatternCount(size);
+            }
+            if (!best || score < *best) {
+                best = score;
+                bestOrder = &order;
+            }
+        }
+
+        vector<Vertex> order;
+        for (auto n : *bestOrder) {
+            order.push_back(n->index);
+        }
+        auto pd = TreeDecomposition::fromPathDecomposition(pathDecompositionFromOrder(graph, order));
+        if (coordinates != nullptr) {
+            auto sweep = forCoordinates(graph, *coordinates);
+            if (sweep.getLargestBagSize() < pd.getLargestBagSize())
+                return sweep;
+        }
+        return pd;
+    }
 }
\ No newline at end of file
@@ -11,6 +11,31 @@ namespace TreeDecomposition {
     TreeDecomposition forGrid(const WeightedIndexedGraph<void> &graph);
     TreeDecomposition forRings(const WeightedIndexedGraph<void> &graph);
 
+    // how far a graph may deviate from a perfect grid/ring lattice to still be handled by forNearGrid/forNearRings
+    struct NearClassTolerance {
+        double maxDeviationRatio = 0.1; // (extra + missing lattice edges) / edge count
+        unsigned int maxExtraWidth = 2; // width increase caused by patching the extra edges into the bags
+    };
+
+    // like forGrid/forRings, but tolerates missing blocks and a few extra edges (e.g. diagonals)
+    // the extra edges are patched into the path decomposition and reported via deviatingEdges
+    TreeDecomposition forNearGrid(const WeightedIndexedGraph<void> &graph, vector<Edge> *deviatingEdges = nullptr, NearClassTolerance tolerance = {});
+    TreeDecomposition forNearRings(const WeightedIndexedGraph<void> &graph, vector<Edge> *deviatingEdges = nullptr, NearClassTolerance tolerance = {});
+
+    // sweeps the vertices along several directions (starting with the principal axis of the coordinates, evaluated in parallel),
+    // picks the direction with the smallest width, ties broken by the predicted ILP size
+    TreeDecomposition forCoordinates(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates, unsigned int directions = 8);
+
+    // coordinates for all vertices, vertices without coordinates are placed at the mean of their neighbors with coordinates
+    Coordinates completeCoordinates(const WeightedIndexedGraph<void> &graph, const Coordinates &coordinates);
+
+    // path decomposition introducing the vertices in the given order, every vertex is forgotten after its last neighbor has been introduced
+    vector<set<Vertex>> pathDecompositionFromOrder(const WeightedIndexedGraph<void> &graph, const vector<Vertex> &order);
+
+    // the narrowest of the path decompositions of a few vertex orders: a preorder of td, breadth-first orders and, if
+    // coordinates are given, the coordinate sweep; for PTNs the width is often close to that of td
+    TreeDecomposition pathDecomposition(const WeightedIndexedGraph<void> &graph, const TreeDecomposition &td, const Coordinates *coordinates = nullptr);
+
     class WrongGraphClassError : public std::runtime_error{
     public:
         WrongGraphClassError(std::string msg) : std::runtime_error(msg) {}
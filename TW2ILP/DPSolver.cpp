@@ -0,0 +1,70 @@
+#include "Solver.h"
+#include "../Solver.h"
+#include "../TreeSolver.h"
+#include "../util.h"
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+namespace Solver {
+
+LinePlanning::LineConcept solveDP(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options) {
+    if (options.allowCycles)
+        throw std::runtime_error("the dynamic program does not support cycles");
+
+    Timer timer;
+    Metrics::StageTimer stage(options.metrics, "dynamic program");
+    unsigned int threads = options.dpThreads != 0 ? options.dpThreads : std::max(1u, std::thread::hardware_concurrency());
+    auto optimum = LinePlanning::Solver::solve(instance, td, threads, options.maxPatternGaps);
+    if (std::isinf(optimum->cost))
+        throw LinePlanning::InfeasibleInstanceError(options.maxPatternGaps < 0 ? "instance is infeasible" : "instance is infeasible with the pattern gap limit");
+    auto lc = optimum->reconstructLineConcept().toLineConcept(&instance);
+    stage.stop();
+    cout << "time for dynamic program: " << timer.get_string() << endl;
+    cout << "objective value: " << optimum->cost << endl;
+    reportPatternGapLimit(options);
+
+    if (options.metrics != nullptr)
+        options.metrics->setValue("objective", optimum->cost);
+    return lc;
+}
+
+LinePlanning::LineConcept solveForest(const LinePlanning::Instance& instance, const Options &options) {
+    Timer timer;
+    Metrics::StageTimer stage(options.metrics, "tree solver");
+    unsigned int threads = options.dpThreads != 0 ? options.dpThreads : std::max(1u, std::thread::hardware_concurrency());
+    auto optimum = LinePlanning::TreeSolver::solve(instance, threads);
+    stage.stop();
+    cout << "time for tree solver: " << timer.get_string() << endl;
+    cout << "objective value: " << optimum.cost << endl;
+
+    if (options.metrics != nullptr)
+        options.metrics->setValue("objective", optimum.cost);
+    return optimum;
+}
+
+void reportPatternGapLimit(const Options &options) {
+    if (options.maxPatternGaps < 0)
+        return;
+    cout << "warning: only path patterns with at most " << options.maxPatternGaps << " inner squares were modelled, the objective value"
+         << " and gap are relative to them and the line concept may not be optimal" << endl;
+    if (options.metrics != nullptr) {
+        options.metrics->setValue("max_pattern_gaps", options.maxPatternGaps);
+        options.metrics->setValue("objective_restricted", 1);
+    }
+}
+
+Backend selectBackend(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options) {
+    if (options.backend != Backend::AUTO)
+        return options.backend;
+    if (options.allowCycles || td.getLargestBagSize() > options.dpMaxWidth+1)
+        return Backend::ILP;
+    for (const auto &[i, e] : instance.graph.edges) {
+        if (e->weight.f_max > options.dpMaxFrequency)
+            return Backend::ILP;
+    }
+    return Backend::DP;
+}
+
+}
@@ -0,0 +1,273 @@
+#include "Solver.h"
+#include "PathPattern.h"
+#include "PatternRules.h"
+#include <cmath>
+#include <memory>
+
+using namespace LinePlanning;
+using namespace std;
+
+namespace Solver{
+
+namespace {
+
+// bytes per variable, constraint and nonzero (Gurobi plus our bookkeeping), and per pattern in the maps of a node
+constexpr double bytesPerVar = 100;
+constexpr double bytesPerConstr = 60;
+constexpr double bytesPerNonzero = 40;
+constexpr double bytesPerEnumeratedPattern = 120;
+
+// state of one prediction, shared by all visitors
+struct SizeTotals {
+    ModelSizeEstimate estimate;
+    double largestNode = 0; // patterns in the maps of the largest node
+    double budgetMB = 0; // the propagation stops once the model exceeds it, 0 for no limit
+
+    void update() {
+        estimate.memoryMB = (estimate.vars*bytesPerVar + estimate.constrs*bytesPerConstr + estimate.nonzeros*bytesPerNonzero
+                + largestNode*bytesPerEnumeratedPattern) / (1024*1024);
+        if (budgetMB > 0 && estimate.memoryMB > budgetMB)
+            estimate.complete = false;
+    }
+};
+
+// mirrors the NiceVisitor of _solve: propagates the active patterns with the bounds of their count variables by the same
+// rules, and counts the variables, constraints and nonzeros it would add instead of building them
+template <class PP>
+class SizeVisitor {
+    set<int> vertices;
+    set<int> introduced;
+    const Instance *instance;
+    const Options *options;
+    shared_ptr<SizeTotals> totals;
+    SlotRenaming<int,char> vertexRenaming;
+    unordered_map<PP, double> c_ub; // the active patterns, by the upper bound of their count variable
+
+    // the right-hand side of the count constraint of a pattern: its number of terms and the sum of the upper bounds of
+    // the positive ones
+    struct Row {
+        unsigned int terms = 0;
+        double ub = 0;
+    };
+
+    bool stopped() const {
+        return !totals->estimate.complete;
+    }
+
+    static double upperBound(const unordered_map<PP, double> &ub, const PP &pp) {
+        auto it = ub.find(pp);
+        return it == ub.end() ? 0 : it->second;
+    }
+
+    void addVars(double count) {
+        totals->estimate.vars += count;
+    }
+
+    void addConstr(double terms) {
+        totals->estimate.constrs++;
+        totals->estimate.nonzeros += terms;
+    }
+
+    // like NiceVisitor::countVariables
+    void countVariables(const unordered_map<PP, Row> &rows, const BagRules &rules, unordered_map<PP, double> &c_ubNew) {
+        for (const auto& [pp, row] : rows) {
+            if (row.terms == 0)
+                continue;
+            auto ub = rules.admissible(pp) ? std::min(row.ub, rules.capacityBound(pp)) : 0;
+            if (ub <= 0) {
+                addConstr(row.terms);
+            } else {
+                addVars(1);
+                addConstr(row.terms+1);
+                c_ubNew[pp] = ub;
+            }
+        }
+        totals->largestNode = std::max(totals->largestNode, (double)rows.size());
+        totals->estimate.largestBagSize = std::max(totals->estimate.largestBagSize, (unsigned int)vertices.size());
+        totals->update();
+    }
+
+public:
+    SizeVisitor(const Instance *instance, const Options *options, shared_ptr<SizeTotals> totals, const unordered_map<int,char> *slots)
+        : instance(instance), options(options), totals(std::move(totals)), vertexRenaming(slots) {}
+
+    void introduce(int v) {
+        if (stopped())
+            return;
+        vertexRenaming.add(v);
+        introduced.insert(v);
+        auto bagNew = vertices;
+        bagNew.insert(v);
+        BagRules rules(*instance, bagNew, introduced, vertexRenaming, options->maxPatternGaps);
+
+        unordered_map<PP, Row> rows;
+        for (const auto& [pp, ub] : c_ub) {
+            rows[pp].terms++;
+            rows[pp].ub += ub;
+        }
+        // i variables
+        for (auto u : vertices) {
+            if (!rules.isAdjacent(vertexRenaming[u], vertexRenaming[v]))
+                continue;
+            auto pp = PP{std::array<char,2>{vertexRenaming[u], vertexRenaming[v]}};
+            auto ub = rules.capacityBound(pp);
+            if (ub <= 0)
+                continue;
+            addVars(1);
+            rows[pp].terms++;
+            rows[pp].ub += ub;
+        }
+        // e and s variables, each moves count from pp to the new pattern
+        auto add = [&](const PP &pp, double ubPP, const PP &to) {
+            if (!rules.isGraphConsistent(to))
+                return;
+            auto ub = std::min(ubPP, rules.capacityBound(to));
+            if (ub <= 0)
+                return;
+            addVars(1);
+            rows[to].terms++;
+            rows[to].ub += ub;
+            rows[pp].terms++;
+        };
+        for (const auto& [pp, ub] : c_ub) {
+            for (auto extension : pp.extensions(vertexRenaming[v]))
+                add(pp, ub, extension);
+            for (auto sub : pp.subdivisions(vertexRenaming[v]))
+                add(pp, ub, sub);
+        }
+
+        vertices.insert(v);
+        unordered_map<PP, double> c_ubNew;
+        countVariables(rows, rules, c_ubNew);
+        c_ub = std::move(c_ubNew);
+    }
+
+    void forget(int v) {
+        if (stopped())
+            return;
+        vertices.erase(v);
+        BagRules rules(*instance, vertices, introduced, vertexRenaming, options->maxPatternGaps);
+        auto symbol = vertexRenaming[v];
+
+        unordered_map<PP, Row> rows;
+        unordered_map<char, unsigned int> cycleTerms; // cycle variables in the edge constraint of a vertex, by its symbol
+        if (options->allowCycles) {
+            for (const auto& [pp, ub] : c_ub) {
+                if (endsWith(pp, PP::SQ) || !endsWith(pp, symbol))
+                    continue;
+                auto ends = endings(pp);
+                auto otherEnd = ends[0] == symbol ? ends[1] : ends[0];
+                if (instance->graph.findEdge(vertexRenaming.inverse(otherEnd), v) == nullptr || ub <= 0)
+                    continue;
+                addVars(1);
+                addConstr(2);
+                rows[pp.forget(symbol).value()].terms++;
+                cycleTerms[otherEnd]++;
+            }
+        }
+        // edge constraints, with a frequency variable if the edge exists
+        for (auto u : vertices) {
+            unsigned int terms = cycleTerms[vertexRenaming[u]];
+            for (const auto& [pp, _] : c_ub) {
+                if (pp.containsEdge(vertexRenaming[u], symbol))
+                    terms++;
+            }
+            if (instance->graph.findEdge(u, v) != nullptr) {
+                addVars(1);
+                addConstr(terms+1);
+            } else if (terms > 0) {
+                addConstr(terms);
+            }
+        }
+        for (const auto& [pp, ub] : c_ub) {
+            auto ppn = pp.forget(symbol);
+            if (ppn.has_value()) {
+                rows[*ppn].terms++;
+                rows[*ppn].ub += ub;
+            }
+        }
+
+        unordered_map<PP, double> c_ubNew;
+        countVariables(rows, rules, c_ubNew);
+        vertexRenaming.erase(v);
+        c_ub = std::move(c_ubNew);
+    }
+
+    void merge(const SizeVisitor &other) {
+        if (stopped())
+            return;
+        introduced.insert(other.introduced.begin(), other.introduced.end());
+        BagRules rules(*instance, vertices, introduced, vertexRenaming, options->maxPatternGaps);
+
+        using VertexSequence = decltype(std::declval<PP>().vertexSequence());
+        unordered_map<VertexSequence, vector<PP>> byVertexSequence2;
+        for (const auto& [pp, _] : other.c_ub) {
+            byVertexSequence2[pp.vertexSequence()].push_back(pp);
+        }
+        unordered_map<PP, Row> rows;
+        unordered_map<PP, unsigned int> unjoined1, unjoined2; // terms of the unjoined constraints, 0 if there is none
+        for (const auto& [pp1, ub1] : c_ub) {
+            auto it = byVertexSequence2.find(pp1.vertexSequence());
+            if (it == byVertexSequence2.end())
+                continue;
+            for (const auto& pp2 : it->second) {
+                auto pp = pp1.join(pp2);
+                if (!pp.has_value() || !rules.isGraphConsistent(*pp) || !rules.admissible(*pp))
+                    continue;
+                auto ub = std::min({ub1, upperBound(other.c_ub, pp2), rules.capacityBound(*pp)});
+                if (ub <= 0)
+                    continue;
+                addVars(1);
+                rows[*pp].terms++;
+                rows[*pp].ub += ub;
+                unjoined1[pp1]++;
+                unjoined2[pp2]++;
+            }
+        }
+        auto addUnjoined = [&](const unordered_map<PP, double> &ubs, const unordered_map<PP, unsigned int> &joins) {
+            for (const auto& [pp, ub] : ubs) {
+                auto it = joins.find(pp);
+                unsigned int terms = 1 + (it == joins.end() ? 0 : it->second);
+                rows[pp].terms += terms;
+                rows[pp].ub += ub;
+                if (it != joins.end())
+                    addConstr(terms);
+            }
+        };
+        addUnjoined(c_ub, unjoined1);
+        addUnjoined(other.c_ub, unjoined2);
+
+        unordered_map<PP, double> c_ubNew;
+        countVariables(rows, rules, c_ubNew);
+        c_ub = std::move(c_ubNew);
+    }
+};
+
+template <class PP>
+ModelSizeEstimate estimate(const Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options) {
+    auto totals = make_shared<SizeTotals>();
+    totals->budgetMB = options.memoryBudgetMB;
+    unordered_map<int,char> slots;
+    for (auto [v, slot] : td.slotAssignment()) {
+        slots[v] = slot;
+    }
+    td.niceVisit([&](){
+        return SizeVisitor<PP>(&instance, &options, totals, &slots);
+        }, true);
+    return totals->estimate;
+}
+
+}
+
+ModelSizeEstimate estimateModelSize(const Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options) {
+    typedef PathPatternOptimized<unsigned int> PP1;
+    typedef PathPatternOptimized<unsigned long long> PP2;
+    auto bagSize = td.getLargestBagSize();
+    if (bagSize <= PP1::maxBagSize)
+        return estimate<PP1>(instance, td, options);
+    if (bagSize <= PP2::maxBagSize)
+        return estimate<PP2>(instance, td, options);
+    throw std::runtime_error("maximum supported treewidth exceeded");
+}
+
+}
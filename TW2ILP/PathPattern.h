@@ -1,6 +1,6 @@
 
-#ifndef LINEPLANNING_PATHPATTERN_H
-#define LINEPLANNING_PATHPATTERN_H
+#ifndef LINEPLANNING_TW2ILP_PATHPATTERN_H
+#define LINEPLANNING_TW2ILP_PATHPATTERN_H
 
 #include <vector>
 #include <array>
@@ -10,6 +10,11 @@
 #include <unordered_set>
 #include <optional>
 #include <stdexcept>
+#include <ostream>
+#include <limits>
+#include <bit>
+#include <string_view>
+#include <numeric>
 
 
 template <class T>
@@ -74,6 +79,39 @@ public:
     }
 };
 
+/*
+ * Same interface as VertexRenaming, but every vertex keeps the target assigned up front for its whole lifetime
+ * (see TreeDecomposition::slotAssignment), so erasing a vertex does not rename the others.
+ */
+template <class T_orig, class T_target>
+class SlotRenaming {
+    const std::unordered_map<T_orig, T_target> *slots;
+    std::unordered_map<T_target, T_orig> occupants;
+
+public:
+    explicit SlotRenaming(const std::unordered_map<T_orig, T_target> *slots) : slots(slots) {}
+
+    const std::unordered_map<T_orig, T_target>* getSlots() const {
+        return slots;
+    }
+
+    const T_target& operator[](T_orig v) const {
+        return slots->at(v);
+    }
+
+    const T_orig& inverse(T_target vt) const {
+        return occupants.at(vt);
+    }
+
+    void add(T_orig v) {
+        occupants[slots->at(v)] = v;
+    }
+
+    void erase(T_orig v) {
+        occupants.erase(slots->at(v));
+    }
+};
+
 class PathPatternVec {
 
 public:
@@ -181,6 +219,49 @@ public:
         return r;
     }
 
+    // the pattern whose joins() contain the pair of this and other (in either order), if any
+    std::optional<PathPatternVec> join(const PathPatternVec &other) const {
+        auto proper = [](const vector<char> &d) {
+            vector<char> r;
+            std::copy_if(d.begin(), d.end(), std::back_inserter(r), [](char c){return c != SQ;});
+            return r;
+        };
+        // squares by gap: gap i lies in front of the i-th proper vertex
+        auto gaps = [](const vector<char> &d) {
+            vector<bool> r(1, false);
+            for (char c : d) {
+                if (c == SQ)
+                    r.back() = true;
+                else
+                    r.push_back(false);
+            }
+            return r;
+        };
+        auto d2 = other.data;
+        if (proper(d2) != proper(data))
+            std::reverse(d2.begin(), d2.end());
+        if (proper(d2) != proper(data))
+            return {};
+        auto g1 = gaps(data), g2 = gaps(d2);
+        if (g1.size() == 2)
+            return g1 == vector<bool>{true, false} && g2 == g1 ? std::optional(PathPatternVec{{SQ, data[1], SQ}}) : std::nullopt;
+        vector<char> dd;
+        unsigned int squareCount = 0;
+        for (size_t i = 0; i < g1.size(); i++) {
+            if (g1[i] && g2[i])
+                return {};
+            if (g1[i] || g2[i]) {
+                dd.push_back(SQ);
+                squareCount++;
+            }
+            if (i+1 < g1.size())
+                dd.push_back(proper(data)[i]);
+        }
+        if (squareCount <= 1)
+            return {};
+        return PathPatternVec{dd};
+    }
+
     template <class T>
     PathPatternVec rename(T renaming) const {
         vector<char> dd = data;
@@ -254,6 +335,15 @@ public:
         return res;
     }
 
+    // all patterns on the given symbols instead of 1..numVertices
+    static vector<PathPatternVec> allPatterns(const vector<char> &symbols) {
+        vector<PathPatternVec> res;
+        for (const auto &pp : allPatterns(symbols.size())) {
+            res.push_back(pp.rename([&](char c){return symbols[c-1];}));
+        }
+        return res;
+    }
+
 
     std::strong_ordering operator<=>(const PathPatternVec &other) const{
         return data <=> other.data;
@@ -300,40 +390,6 @@ constexpr size_t spow(size_t a, size_t b)
 }
 
 
-template <unsigned int B, class T>
-constexpr unsigned int countDigits(T number, unsigned int minDigitCount, unsigned int maxDigitCount)
-{
-    if (minDigitCount == maxDigitCount)
-        return minDigitCount;
-    auto mid = (maxDigitCount+minDigitCount)/2;
-    if (number < spow(B, mid)) {
-        return countDigits<B,T>(number, minDigitCount, mid);
-    } else {
-        return countDigits<B,T>(number, mid+1, maxDigitCount);
-    }
-}
-
-template <unsigned int B, class T>
-constexpr T reverse_number(T number) {
-    T r = 0;
-    while (number != 0){
-        r *= B;
-        r += (number%B);
-        number /= B;
-    }
-    return r;
-}
-template <unsigned int B, class T>
-constexpr T reverse_number_fixed(T number, unsigned int numDigits) {
-    T r = 0;
-    for (int i = 0; i < numDigits; i++){
-        r *= B;
-        r += (number%B);
-        number /= B;
-    }
-    return r;
-}
-
 /*class PathPatternOptimized {
     unsigned int data;
     friend std::hash<PathPatternOptimized>;
@@ -358,9 +414,54 @@ template<> struct std::hash<PathPatternOptimized>
 };*/
 
 
+// finalizer of splitmix64, spreads the small and similar pattern encodings over all bits
+inline std::size_t mixHash(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (std::size_t)x;
+}
+
+// vector with a fixed capacity and inline storage, for results of pattern operations without heap allocation
+template <class T, unsigned int N>
+class FixedVector {
+    std::array<T, N> elements;
+    unsigned int count = 0;
+
+public:
+    void push_back(const T &t) {
+        elements[count++] = t;
+    }
+
+    unsigned int size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    const T& operator[](unsigned int i) const {
+        return elements[i];
+    }
+
+    auto begin() const {
+        return elements.begin();
+    }
+
+    auto end() const {
+        return elements.begin()+count;
+    }
+};
+
 /*
  * Path pattern = Permutation of a subset of all possible vertices, with some squares sprinkled in-between.
- * Encoding: Encode as a tuple of (sub_permutation, square_mask)
+ * Encoding: the proper vertices as 4 bit symbols (the first one in the lowest bits) above a square mask,
+ * whose bit i is set if there is a square in front of the i-th proper vertex (bit count: after the last one).
+ * All operations work on this integer. The direction is normalized on construction (the smaller of the two encodings),
+ * so equal patterns have equal data.
  */
 template <class IntegerType>
 class PathPatternOptimized {
@@ -368,100 +469,112 @@ class PathPatternOptimized {
 
     IntegerType data;
 
-    //static_assert(_sqmask_bits+slog2(spow(maxBagSize+1, maxBagSize)) <= std::numeric_limits<Td>::digits, "maxBagSize too large!" );
+    static constexpr unsigned int _symbol_bits = 4;
 
-    // s+1+slog2(spow(s+1, s)) <= bits
+public:
+    // one symbol and one square bit per vertex plus the final square bit have to fit, and the symbols 1..maxBagSize into 4 bits
+    static constexpr int maxBagSize = std::min((std::numeric_limits<IntegerType>::digits-1)/(int)(_symbol_bits+1), (1<<_symbol_bits)-1);
+private:
+    static constexpr auto _sqmask_bits = maxBagSize+1;
 
-    static constexpr auto _maxBagSize(int bits) {
-        int s = 1;
-        int bitsRequired[] = {1, 3, 7, 10, 15, 19, 24, 29, 35, 40, 46, 52, 58, 64, 70, 76, 83, 89, 96, 103, 109, 116, 123, 130, 137, 144, 151, 158, 166, 173, 180};
-        while (bitsRequired[s] <= bits) {
-            s++;
-        }
-        return s-1;
+    // mask of the lowest i bits
+    static constexpr IntegerType _low(unsigned int i) {
+        return (IntegerType(1)<<i)-1;
     }
 
+    static constexpr IntegerType _encode(IntegerType perm, IntegerType sqmask) {
+        return sqmask | (perm<<_sqmask_bits);
+    }
 
-public:
-    static auto constexpr maxBagSize = _maxBagSize(std::numeric_limits<decltype(data)>::digits);
-private:
-    static constexpr auto _sqmask_bits = maxBagSize+1;
+    static unsigned int _symbolCount(IntegerType perm) {
+        return (std::bit_width(perm)+_symbol_bits-1)/_symbol_bits;
+    }
 
-    unsigned int properVertexCount() const {
-        return countDigits<maxBagSize+1, decltype(data)>(_perm(), 1u, maxBagSize);
+    static IntegerType _reverse(IntegerType data) {
+        IntegerType perm = data>>_sqmask_bits, sqmask = data&_low(_sqmask_bits);
+        auto n = _symbolCount(perm);
+        IntegerType perm2 = 0, sqmask2 = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            perm2 |= ((perm>>(i*_symbol_bits))&_low(_symbol_bits)) << ((n-1-i)*_symbol_bits);
+        }
+        for (unsigned int i = 0; i <= n; i++) {
+            sqmask2 |= ((sqmask>>i)&1) << (n-i);
+        }
+        return _encode(perm2, sqmask2);
     }
 
+    static IntegerType _normalize(IntegerType data) {
+        return std::min(data, _reverse(data));
+    }
 
-    auto _perm() const {
+    unsigned int properVertexCount() const {
+        return _symbolCount(_perm());
+    }
+
+    IntegerType _perm() const {
         return data>>_sqmask_bits;
     }
 
-    auto _sqmask() const {
-        return data&IntegerType((1<<_sqmask_bits)-1);
+    IntegerType _sqmask() const {
+        return data&_low(_sqmask_bits);
+    }
+
+    char _symbol(unsigned int i) const {
+        return (char)((_perm()>>(i*_symbol_bits))&_low(_symbol_bits));
+    }
+
+    bool _square(unsigned int i) const {
+        return (data>>i)&1;
     }
 
-    auto _reversed() const {
-        auto dc = properVertexCount();
-        auto perm2 = reverse_number_fixed<maxBagSize+1>(_perm(), dc);
-        auto sqmask2 = reverse_number_fixed<2>(_sqmask(), dc+1);
-        return (perm2<<_sqmask_bits) | sqmask2;
+    // position of c among the proper vertices, -1 if c does not occur
+    int _find(char c) const {
+        auto n = properVertexCount();
+        for (unsigned int i = 0; i < n; i++) {
+            if (_symbol(i) == c)
+                return i;
+        }
+        return -1;
     }
 
-    PathPatternOptimized(IntegerType data) : data(data){
+    explicit PathPatternOptimized(IntegerType data) : data(_normalize(data)){
+
+    }
 
+    static void _addPatterns(const vector<char> &symbols, IntegerType perm, unsigned int n, unsigned int used, std::unordered_set<PathPatternOptimized> &res) {
+        for (IntegerType sqmask = n == 1 ? 1 : 0; n >= 1 && sqmask <= _low(n+1); sqmask++) {
+            auto raw = _encode(perm, sqmask);
+            if (_normalize(raw) == raw)
+                res.insert(PathPatternOptimized(raw));
+        }
+        for (unsigned int i = 0; i < symbols.size(); i++) {
+            if (!((used>>i)&1))
+                _addPatterns(symbols, perm | (IntegerType(symbols[i])<<(n*_symbol_bits)), n+1, used | (1u<<i), res);
+        }
     }
 
 public:
     static constexpr char SQ = 0;
 
-    PathPatternOptimized(vector<char> vec){
-        /*Td rdata[2];
-        for (int k = 0; k < 2; k++){
-            Td sqmask = 0;
-            int si = 0;
-            char verts[maxBagSize];
-            for (int i = 0; i < vec.size(); i++){
-                if (vec[i] != SQ){
-                    verts[si] = vec[i];
-                    si++;
-                }
-                else {
-                    sqmask |= 1<<si;
-                }
-            }
-            Td perm = 0;
-            for (int i = 0; i < si; i++){
-                perm *= maxBagSize+1;
-                perm += verts[i];
-            }
-            rdata[k] = sqmask | (perm<<_sqmask_bits);
-            if (k == 0) {
-                std::reverse(vec.begin(), vec.end());
-            }
-        }
-        this->data = std::min(rdata[0], rdata[1]);*/
+    // placeholder for fixed size containers, not a valid pattern
+    PathPatternOptimized() : data(0) {}
 
-        IntegerType sqmask = 0;
-        int si = 0;
-        char verts[maxBagSize];
-        for (int i = 0; i < vec.size(); i++){
-            if (vec[i] != SQ){
-                verts[si] = vec[i];
+    PathPatternOptimized(const vector<char> &vec){
+        IntegerType perm = 0, sqmask = 0;
+        unsigned int si = 0;
+        for (char c : vec) {
+            if (c != SQ) {
+                perm |= IntegerType(c) << (si*_symbol_bits);
                 si++;
             }
             else {
-                sqmask |= 1<<si;
+                sqmask |= IntegerType(1) << si;
             }
         }
-        IntegerType perm = 0;
-        for (int i = 0; i < si; i++){
-            perm *= maxBagSize+1;
-            perm += verts[i];
-        }
-        this->data = sqmask | (perm<<_sqmask_bits);
+        this->data = _normalize(_encode(perm, sqmask));
 #ifndef NDEBUG
         // path pattern too short
-        if (_perm() == 0 || (_perm() <= maxBagSize == 1 && _sqmask() == 0))
+        if (si == 0 || (si == 1 && sqmask == 0))
             throw 0;
 #endif
     }
@@ -475,138 +588,148 @@ public:
 
     vector<char> toVec() const {
         vector<char> vec;
-        vector<char> verts;
-        auto perm = _perm();
-        auto sqmask = _sqmask();
-        while (perm != 0) {
-            verts.push_back(perm%(maxBagSize+1));
-            perm /= maxBagSize+1;
-        }
-        std::reverse(verts.begin(), verts.end());
-        int si = verts.size();
-        while (si >= 0) {
-            if (sqmask & (1<<si)) {
+        auto n = properVertexCount();
+        for (unsigned int i = 0; i <= n; i++) {
+            if (_square(i))
                 vec.push_back(SQ);
-            }
-            if (si >= 1)
-                vec.push_back(verts[si-1]);
-            si--;
+            if (i < n)
+                vec.push_back(_symbol(i));
         }
         return vec;
     }
 
     static std::unordered_set<PathPatternOptimized> allPatterns(int numVertices) {
-        if (numVertices > maxBagSize)
+        vector<char> symbols(numVertices);
+        std::iota(symbols.begin(), symbols.end(), 1);
+        return allPatterns(symbols);
+    }
+
+    // all patterns on the given symbols instead of 1..numVertices
+    static std::unordered_set<PathPatternOptimized> allPatterns(const vector<char> &symbols) {
+        if (symbols.size() > maxBagSize || std::any_of(symbols.begin(), symbols.end(), [](char c){return c > maxBagSize;}))
             throw std::runtime_error("maxBagSize exceeded");
         std::unordered_set<PathPatternOptimized> res;
-        /*for (int vc = 1; vc <= numVertices; vc++){
-
-        }*/
-        auto h = PathPatternVec::allPatterns(numVertices);
-        for (auto pp : h) {
-            res.insert(PathPatternOptimized{pp});
-        }
+        _addPatterns(symbols, 0, 0, 0, res);
         return res;
     }
 
     bool containsEdge(char c1, char c2) const {
-        auto data = toVec();
-        for (int i = 0; i+1 < data.size(); i++)
+        auto n = properVertexCount();
+        for (unsigned int i = 0; i+1 < n; i++)
         {
-            if (data[i] == c1 && data[i+1] == c2 || data[i] == c2 && data[i+1] == c1)
+            if (_square(i+1))
+                continue;
+            auto a = _symbol(i), b = _symbol(i+1);
+            if (a == c1 && b == c2 || a == c2 && b == c1)
                 return true;
         }
         return false;
     }
 
+    // c becomes a square, merged with the neighboring squares
     std::optional<PathPatternOptimized> forget(char c) const {
-        auto ppv = PathPatternVec(toVec());
-        auto r = ppv.forget(c);
-        if (r.has_value())
-            return PathPatternOptimized(r.value());
-        else
+        int i = _find(c);
+        if (i < 0)
+            return *this;
+        if (properVertexCount() == 1)
             return {};
-    }
-
-    vector<PathPatternOptimized> extensions(char newV) const {
-        vector<PathPatternOptimized> r;
-        vector<char> data = toVec();
-        if (data[0] != SQ){
-            vector<char> dd = data;
-            dd.insert(dd.begin(), newV);
-            r.push_back(PathPatternOptimized{dd});
+        auto perm = _perm(), sqmask = _sqmask();
+        IntegerType perm2 = (perm&_low(i*_symbol_bits)) | ((perm>>((i+1)*_symbol_bits)) << (i*_symbol_bits));
+        IntegerType sqmask2 = (sqmask&_low(i)) | (IntegerType(1)<<i) | ((sqmask>>(i+2)) << (i+1));
+        return PathPatternOptimized(_encode(perm2, sqmask2));
+    }
+
+    FixedVector<PathPatternOptimized, 2> extensions(char newV) const {
+        FixedVector<PathPatternOptimized, 2> r;
+        auto n = properVertexCount();
+        auto perm = _perm(), sqmask = _sqmask();
+        if (!_square(0)){
+            r.push_back(PathPatternOptimized(_encode((perm<<_symbol_bits) | IntegerType(newV), sqmask<<1)));
         }
-        if (data.back() != SQ){
-            vector<char> dd = data;
-            dd.push_back(newV);
-            r.push_back(PathPatternOptimized{dd});
+        if (!_square(n)){
+            r.push_back(PathPatternOptimized(_encode(perm | (IntegerType(newV) << (n*_symbol_bits)), sqmask)));
         }
         return r;
     }
 
-    vector<PathPatternOptimized> subdivisions(char newV) const {
-        vector<PathPatternOptimized> r;
-        vector<char> data = toVec();
-        for (int i = 0; i+1 < data.size(); i++)
+    FixedVector<PathPatternOptimized, maxBagSize> subdivisions(char newV) const {
+        FixedVector<PathPatternOptimized, maxBagSize> r;
+        auto n = properVertexCount();
+        auto perm = _perm(), sqmask = _sqmask();
+        // insert newV in front of the i-th proper vertex
+        for (unsigned int i = 1; i < n; i++)
         {
-            if (data[i] != SQ && data[i+1] != SQ){
-                vector<char> dd = data;
-                dd.insert(dd.begin()+(i+1), newV);
-                r.push_back(PathPatternOptimized{dd});
-            }
+            if (_square(i))
+                continue;
+            IntegerType perm2 = (perm&_low(i*_symbol_bits)) | (IntegerType(newV) << (i*_symbol_bits)) | ((perm>>(i*_symbol_bits)) << ((i+1)*_symbol_bits));
+            IntegerType sqmask2 = (sqmask&_low(i)) | ((sqmask>>i) << (i+1));
+            r.push_back(PathPatternOptimized(_encode(perm2, sqmask2)));
         }
         return r;
     }
 
     vector<std::pair<PathPatternOptimized,PathPatternOptimized>> joins() const {
-        unsigned int squareCount = std::popcount(_sqmask());
+        auto sqmask = _sqmask();
+        unsigned int squareCount = std::popcount(sqmask);
         if (squareCount <= 1)
             return {};
 
         //special symmetric case: {SQ, x, SQ}
         if (properVertexCount() == 1){
-            auto v = (decltype(SQ))_perm();
-            auto pp = PathPatternOptimized{{SQ, v}};
+            auto pp = PathPatternOptimized(_encode(_perm(), 1));
             return {std::make_pair(pp, pp)};
         }
 
-        vector<char> data = toVec();
+        // every subset of the squares goes to the first half, the others to the second one;
+        // with at least two proper vertices both halves are valid patterns
         vector<std::pair<PathPatternOptimized,PathPatternOptimized>> r;
-        for (unsigned int j = 0; j < (1<<squareCount); j++){
-            vector<char> dd1, dd2;
-            int k = 0;
-            for (int i = 0; i < data.size(); i++){
-                if (data[i] == SQ){
-                    if ((j>>k)&1){
-                        dd1.push_back(data[i]);
-                    } else {
-                        dd2.push_back(data[i]);
-                    }
-                    k++;
-                }else {
-                    dd1.push_back(data[i]);
-                    dd2.push_back(data[i]);
-                }
-            }
-            if (dd1.size() >= 2 && dd2.size() >= 2)
-                r.push_back(std::make_pair(PathPatternOptimized{dd1}, PathPatternOptimized{dd2}));
+        r.reserve(size_t(1)<<squareCount);
+        auto perm = _perm();
+        for (IntegerType sub = sqmask; ; sub = (sub-1)&sqmask){
+            r.push_back(std::make_pair(PathPatternOptimized(_encode(perm, sub)), PathPatternOptimized(_encode(perm, sqmask&~sub))));
+            if (sub == 0)
+                break;
         }
         return r;
     }
 
+    // the proper vertices up to reversal, equal for patterns that differ only in their squares
+    IntegerType vertexSequence() const {
+        return _normalize(_encode(_perm(), 0))>>_sqmask_bits;
+    }
+
+    // the pattern whose joins() contain the pair of this and other (in either order), if any
+    std::optional<PathPatternOptimized> join(const PathPatternOptimized &other) const {
+        auto perm = _perm(), sqmask = _sqmask();
+        IntegerType sqmask2;
+        if (other._perm() == perm)
+            sqmask2 = other._sqmask();
+        else if ((_reverse(other.data)>>_sqmask_bits) == perm)
+            sqmask2 = _reverse(other.data)&_low(_sqmask_bits);
+        else
+            return {};
+        if (properVertexCount() == 1) {
+            if (sqmask == 1 && sqmask2 == 1)
+                return PathPatternOptimized(_encode(perm, 3));
+            return {};
+        }
+        if ((sqmask&sqmask2) != 0 || std::popcount(sqmask|sqmask2) <= 1)
+            return {};
+        return PathPatternOptimized(_encode(perm, sqmask|sqmask2));
+    }
+
     template <class T>
     PathPatternOptimized rename(T renaming) const {
-        vector<char> dd = toVec();
-        for (auto& c : dd) {
-            if (c == SQ)
-                continue;
-            c = renaming(c);
+        auto n = properVertexCount();
+        IntegerType perm = 0;
+        for (unsigned int i = 0; i < n; i++) {
+            perm |= IntegerType((unsigned char)renaming(_symbol(i))) << (i*_symbol_bits);
         }
-        return PathPatternOptimized{dd};
+        return PathPatternOptimized(_encode(perm, _sqmask()));
     }
 
     bool operator==(const PathPatternOptimized &rhs) const {
-        return data == rhs.data || data == rhs._reversed();
+        return data == rhs.data;
     }
 };
 
@@ -615,12 +738,11 @@ struct std::hash<PathPatternOptimized<T>>
 {
     std::size_t operator()(PathPatternOptimized<T> const& pp) const
     {
-        auto d = std::min(pp.data, pp._reversed());
-        return std::hash<decltype(d)>()(d);
+        return mixHash(pp.data);
     }
 };
 
-vector<char> toVector(const PathPatternVec &pp) {
+inline vector<char> toVector(const PathPatternVec &pp) {
     return pp.data;
 }
 
@@ -629,7 +751,7 @@ vector<char> toVector(const PathPatternOptimized<T> &pp) {
     return pp.toVec();
 }
 
-bool endsWith(const PathPatternVec &pp, char what) {
+inline bool endsWith(const PathPatternVec &pp, char what) {
     return pp.data[0] == what || pp.data.back() == what;
 }
 
@@ -638,7 +760,7 @@ bool endsWith(const PP &pp, char what) {
     return endsWith(PathPatternVec{toVector(pp)}, what);
 }
 
-std::array<char,2> endings(const PathPatternVec &pp) {
+inline std::array<char,2> endings(const PathPatternVec &pp) {
     return {pp.data[0], pp.data.back()};
 }
 
@@ -696,4 +818,4 @@ public:
     }
 };*/
 
-#endif //LINEPLANNING_PATHPATTERN_H
+#endif //LINEPLANNING_TW2ILP_PATHPATTERN_H
@@ -0,0 +1,94 @@
+#ifndef LINEPLANNING_TW2ILP_PATTERNRULES_H
+#define LINEPLANNING_TW2ILP_PATTERNRULES_H
+
+#include "../LinePlanning.h"
+#include "PathPattern.h"
+#include <set>
+#include <cmath>
+#include <limits>
+
+namespace Solver {
+
+    // which path patterns of a bag may have a nonzero count, and bounds on their counts. Used by the model construction
+    // (Solver.cpp) and by the size prediction (ModelSize.cpp), so that both arrive at the same patterns.
+    class BagRules {
+        // which bag vertices, indexed by pattern symbol, may be consecutive in a pattern with nonzero count:
+        // PTN edges, and pairs that can still be subdivided because both have a neighbor that is not introduced yet.
+        // Any other consecutive pair is forced to 0 when one of the two is forgotten.
+        vector<vector<bool>> adjacent;
+        vector<double> capacity; // getTotalFmax of the bag vertices, indexed by pattern symbol
+        int maxGaps;
+
+    public:
+        // introduced: all vertices introduced below the node so far, maxGaps: Options::maxPatternGaps
+        BagRules(const LinePlanning::Instance &instance, const std::set<int> &bag, const std::set<int> &introduced,
+                 const SlotRenaming<int,char> &slots, int maxGaps) : maxGaps(maxGaps) {
+            unsigned int bound = 1;
+            for (auto u : bag) {
+                bound = std::max(bound, (unsigned int)slots[u]+1);
+            }
+            adjacent.assign(bound, vector<bool>(bound, false));
+            capacity.assign(bound, 0);
+            vector<int> pending;
+            for (auto u : bag) {
+                capacity[slots[u]] = instance.getTotalFmax(u);
+                for (const auto& [nb, _] : instance.graph.nodes.at(u)->incidentEdges) {
+                    if (!introduced.contains(nb)) {
+                        pending.push_back(u);
+                        break;
+                    }
+                }
+                for (auto w : bag) {
+                    if (u != w && instance.graph.findEdge(u, w) != nullptr)
+                        adjacent[slots[u]][slots[w]] = true;
+                }
+            }
+            for (auto u : pending) {
+                for (auto w : pending) {
+                    if (u != w)
+                        adjacent[slots[u]][slots[w]] = true;
+                }
+            }
+        }
+
+        bool isAdjacent(char s1, char s2) const {
+            return adjacent[s1][s2];
+        }
+
+        template <class PP>
+        bool isGraphConsistent(const PP &pp) const {
+            auto data = toVector(pp);
+            for (size_t i = 0; i+1 < data.size(); i++) {
+                if (data[i] != PP::SQ && data[i+1] != PP::SQ && !adjacent[data[i]][data[i+1]])
+                    return false;
+            }
+            return true;
+        }
+
+        // every line matching pp passes its proper vertices, using two incident edges at those inside the pattern
+        template <class PP>
+        double capacityBound(const PP &pp) const {
+            auto data = toVector(pp);
+            double bound = std::numeric_limits<double>::infinity();
+            for (size_t i = 0; i < data.size(); i++) {
+                if (data[i] == PP::SQ)
+                    continue;
+                bool interior = i > 0 && i+1 < data.size();
+                bound = std::min(bound, interior ? std::floor(capacity[data[i]]/2) : capacity[data[i]]);
+            }
+            return bound;
+        }
+
+        // whether pp is in the pattern family of Options::maxPatternGaps
+        template <class PP>
+        bool admissible(const PP &pp) const {
+            if (maxGaps < 0)
+                return true;
+            auto data = toVector(pp);
+            auto gaps = data.size() < 3 ? 0 : std::count(data.begin()+1, data.end()-1, PP::SQ);
+            return gaps <= maxGaps;
+        }
+    };
+}
+
+#endif //LINEPLANNING_TW2ILP_PATTERNRULES_H
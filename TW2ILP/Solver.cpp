@@ -1,11 +1,16 @@
 
 #include "Solver.h"
 #include "PathPattern.h"
+#include "PatternRules.h"
 #include "../util.h"
+#include "../Metrics.h"
+#include "../LocalSearch.h"
 #include <unordered_map>
 #include <gurobi_c++.h>
 #include <csignal>
 #include <bitset>
+#include <cmath>
+#include <climits>
 
 
 using namespace LinePlanning;
@@ -21,18 +26,63 @@ bool isZero(const GRBLinExpr &expr){
     return expr.size() == 0;
 }
 
-unordered_map<char, unsigned int> varCounts;
+// state of one model construction, shared by all visitors
+struct BuildMetrics {
+    unordered_map<char, unsigned int> varCounts;
+    unsigned int prunedVars = 0; // variables not created because their upper bound is 0
+    unsigned int excludedPatterns = 0; // patterns forced to 0 by Options::maxPatternGaps
+    unsigned int nodeSequence = 0;
+    Metrics::Registry *registry = nullptr;
+};
+
+// the solution of the model, read with one bulk call; only the nonzero values are kept, sorted by variable index
+class SparseSolution {
+    vector<pair<int, int>> nonzeros;
 
-int get(const Var& v){
-    auto xd = v.get(GRB_DoubleAttr_X);
-    int x = (int)xd;
-    if (xd != (double)x) {
-        cout << "warning: got non-integer value from Gurobi!" << endl;
-        x = round(xd);
+public:
+    unsigned int roundedCount = 0; // values that were not integral
+    double largestDeviation = 0;
+
+    explicit SparseSolution(GRBModel &model) {
+        auto count = model.get(GRB_IntAttr_NumVars);
+        unique_ptr<Var[]> vars(model.getVars());
+        unique_ptr<double[]> x(model.get(GRB_DoubleAttr_X, vars.get(), count));
+        for (int i = 0; i < count; i++) {
+            auto rounded = std::round(x[i]);
+            if (x[i] != rounded) {
+                roundedCount++;
+                largestDeviation = std::max(largestDeviation, std::abs(x[i]-rounded));
+            }
+            if (rounded != 0)
+                nonzeros.emplace_back(vars[i].index(), (int)rounded);
+        }
+    }
+
+    int value(const Var &var) const {
+        auto it = std::lower_bound(nonzeros.begin(), nonzeros.end(), make_pair(var.index(), INT_MIN));
+        return it != nonzeros.end() && it->first == var.index() ? it->second : 0;
     }
-    //cout << v.index() << ": " << x << endl;
-    return x;
-}
+
+    // calls f(entry, value) for the entries of list (tuples ending with their variable) whose value is nonzero.
+    // The variables of a list are created in order, usually with consecutive indices, so only the nonzeros in that range are visited.
+    template <class Entry, class F>
+    void forEachNonzero(const vector<Entry> &list, F f) const {
+        if (list.empty())
+            return;
+        int first = std::get<Var>(list.front()).index();
+        int last = std::get<Var>(list.back()).index();
+        if (last-first+1 != (int)list.size()) {
+            for (const auto &entry : list) {
+                if (auto v = value(std::get<Var>(entry)); v != 0)
+                    f(entry, v);
+            }
+            return;
+        }
+        for (auto it = std::lower_bound(nonzeros.begin(), nonzeros.end(), make_pair(first, INT_MIN)); it != nonzeros.end() && it->first <= last; it++) {
+            f(list[it->first-first], it->second);
+        }
+    }
+};
 
 ostream& operator<<(ostream& os, std::set<int> s) {
     os << "{";
@@ -108,14 +158,12 @@ public:
         //    log();
     }
 
-    template <class F>
-    void forget(char toForget, F translation){
+    void forget(char toForget){
         unordered_map<PP, vector<pair<Path, unsigned int>>> newmap;
         for (auto [pp, vec] : paths) {
             auto opt = pp.forget(toForget);
             if (opt.has_value()){
-                auto pp2 = opt.value().rename(translation);
-                newmap[pp2] += vec;
+                newmap[opt.value()] += vec;
             } else {
                 forgotten += vec;
             }
@@ -125,19 +173,7 @@ public:
         //    log();
     }
 
-    template<class F>
-    void rename(F translation){
-        unordered_map<PP, vector<pair<Path, unsigned int>>> newmap;
-        for (auto [pp, vec] : paths) {
-            auto pp2 = pp.rename(translation);
-            newmap[pp2] += vec;
-        }
-        paths = newmap;
-        //if (debug_log)
-        //    log();
-    }
-
-    void extendOrSubdivide(const PP& pp, const VertexRenaming<int,char> &vertexRenaming, char c1, char c2, char newV, unsigned int count) {
+    void extendOrSubdivide(const PP& pp, const SlotRenaming<int,char> &vertexRenaming, char c1, char c2, char newV, unsigned int count) {
         if (c1 == PP::SQ) {
             std::swap(c1, c2);
         }
@@ -188,7 +224,7 @@ public:
         //    log();
     }
 
-    void join(const PP& pp1, const PP& pp2, const PP& ppRes, unsigned int count, MappedPathCollection &other, const VertexRenaming<int,char> &vertexRenaming) {
+    void join(const PP& pp1, const PP& pp2, const PP& ppRes, unsigned int count, MappedPathCollection &other, const SlotRenaming<int,char> &vertexRenaming) {
         vector<char> mergePoints;
         for (char c : toVector(pp1)) {
             if (c != PP::SQ) {
@@ -244,7 +280,6 @@ public:
                 it2++;
             }
 
-            add(ppRes, resPath, actualCount);
             back1.second -= actualCount;
             if (back1.second == 0){
                 paths[pp1].pop_back();
@@ -253,6 +288,8 @@ public:
             if (back2.second == 0){
                 other.paths[pp2].pop_back();
             }
+            // after the updates of back1, as ppRes may equal pp1
+            add(ppRes, resPath, actualCount);
             count -= actualCount;
         }
         //if (debug_log)
@@ -289,7 +326,7 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         struct Join;
         struct Leaf;
 
-        virtual void reconstruct(MappedPathCollection<PP> &mpc, VertexRenaming<int,char> &vertexRenaming) const = 0;
+        virtual void reconstruct(MappedPathCollection<PP> &mpc, SlotRenaming<int,char> &vertexRenaming, const SparseSolution &solution) const = 0;
     };
 
     struct ReconstructionTree::Introduce : public ReconstructionTree {
@@ -299,22 +336,18 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         vector<tuple<PP,PP,Var>> s_vars;
         vector<tuple<PP,Var>> i_vars;
 
-        void reconstruct(MappedPathCollection<PP> &mpc, VertexRenaming<int,char> &vertexRenaming) const override{
-            child->reconstruct(mpc, vertexRenaming);
+        void reconstruct(MappedPathCollection<PP> &mpc, SlotRenaming<int,char> &vertexRenaming, const SparseSolution &solution) const override{
+            child->reconstruct(mpc, vertexRenaming, solution);
             vertexRenaming.add(vertex);
 
-            for (const auto& [pp, var] : i_vars){
-                auto vv = get(var);
-                if (vv == 0)
-                    continue;
+            solution.forEachNonzero(i_vars, [&](const auto &entry, int vv){
+                const auto& [pp, var] = entry;
                 auto data = toVector(pp);
                 mpc.add(pp, Path{{vertexRenaming.inverse(data[0]), vertexRenaming.inverse(data[1])}}, vv);
-            }
+            });
 
-            for (const auto& [pp1, pp2, var] : e_vars){
-                auto vv = get(var);
-                if (vv == 0)
-                    continue;
+            solution.forEachNonzero(e_vars, [&](const auto &entry, int vv){
+                const auto& [pp1, pp2, var] = entry;
                 char c1;
                 auto data = toVector(pp2);
                 auto it = std::find(data.begin(), data.end(), vertexRenaming[vertex]);
@@ -330,19 +363,17 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
                 //}
 
                 mpc.extendOrSubdivide(pp1, vertexRenaming, c1, PP::SQ, vertexRenaming[vertex], vv);
-            }
+            });
 
-            for (const auto& [pp1, pp2, var] : s_vars){
-                auto vv = get(var);
-                if (vv == 0)
-                    continue;
+            solution.forEachNonzero(s_vars, [&](const auto &entry, int vv){
+                const auto& [pp1, pp2, var] = entry;
                 char c1,c2;
                 auto data = toVector(pp2);
                 auto it = std::find(data.begin(), data.end(), vertexRenaming[vertex]);
                 c1 = *(it-1);
                 c2 = *(it+1);
                 mpc.extendOrSubdivide(pp1, vertexRenaming, c1, c2, vertexRenaming[vertex], vv);
-            }
+            });
         }
     };
 
@@ -351,18 +382,14 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         shared_ptr<ReconstructionTree> child;
         vector<tuple<PP,Var>> cycle_vars;
 
-        void reconstruct(MappedPathCollection<PP> &mpc, VertexRenaming<int,char> &vertexRenaming) const override{
-            child->reconstruct(mpc, vertexRenaming);
+        void reconstruct(MappedPathCollection<PP> &mpc, SlotRenaming<int,char> &vertexRenaming, const SparseSolution &solution) const override{
+            child->reconstruct(mpc, vertexRenaming, solution);
 
-            for (const auto& [pp, var] : cycle_vars){
-                auto vv = get(var);
-                if (vv == 0)
-                    continue;
-                mpc.makeCycle(pp, vv);
-            }
+            solution.forEachNonzero(cycle_vars, [&](const auto &entry, int vv){
+                mpc.makeCycle(std::get<PP>(entry), vv);
+            });
 
-            auto translate = vertexRenaming.renamingCausedByErase(vertex);
-            mpc.forget(vertexRenaming[vertex], translate);
+            mpc.forget(vertexRenaming[vertex]);
             vertexRenaming.erase(vertex);
         }
     };
@@ -371,23 +398,17 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         shared_ptr<ReconstructionTree> child1, child2;
         vector<tuple<PP,PP,PP,Var>> j_vars;
 
-        void reconstruct(MappedPathCollection<PP> &mpc, VertexRenaming<int,char> &vertexRenaming) const override{
-            child1->reconstruct(mpc, vertexRenaming);
+        void reconstruct(MappedPathCollection<PP> &mpc, SlotRenaming<int,char> &vertexRenaming, const SparseSolution &solution) const override{
+            child1->reconstruct(mpc, vertexRenaming, solution);
             MappedPathCollection<PP> mpc2;
-            VertexRenaming<int,char> vertexRenaming2;
-            child2->reconstruct(mpc2, vertexRenaming2);
+            // both children use the same slots, so the patterns of mpc2 need no translation
+            SlotRenaming<int,char> vertexRenaming2{vertexRenaming.getSlots()};
+            child2->reconstruct(mpc2, vertexRenaming2, solution);
 
-            auto translate = [&](char c){
-                return vertexRenaming[vertexRenaming2.inverse(c)];
-            };
-            mpc2.rename(translate);
-
-            for (const auto& [pp1, pp2, ppRes, var] : j_vars){
-                auto vv = get(var);
-                if (vv == 0)
-                    continue;
+            solution.forEachNonzero(j_vars, [&](const auto &entry, int vv){
+                const auto& [pp1, pp2, ppRes, var] = entry;
                 mpc.join(pp1, pp2, ppRes, vv, mpc2, vertexRenaming);
-            }
+            });
 
             mpc.add(mpc2);
         }
@@ -395,24 +416,98 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
 
     struct ReconstructionTree::Leaf : public ReconstructionTree {
 
-        void reconstruct(MappedPathCollection<PP> &mpc, VertexRenaming<int,char> &vertexRenaming) const override{
+        void reconstruct(MappedPathCollection<PP> &mpc, SlotRenaming<int,char> &vertexRenaming, const SparseSolution &solution) const override{
         }
     };
 
     class NiceVisitor{
 
         set<int> vertices;
+        set<int> introduced; // all vertices this visitor (including merged ones) has introduced so far
         const Instance* instance;
         GRBModel *model;
         const Options *options;
+        BuildMetrics *buildMetrics;
 
         unordered_map<PP, GRBLinExpr> c_expr;
-        VertexRenaming<int,char> vertexRenaming;
+        unordered_map<PP, double> c_ub; // upper bound of c_expr, missing means 0
+        SlotRenaming<int,char> vertexRenaming; // fixed slots of the decomposition, so forget and merge need no renaming
 
         shared_ptr<ReconstructionTree> rTree;
 
+        // counts of the current operation
+        unsigned long long nodeVars = 0, nodeConstrs = 0;
+        Timer<> nodeTimer;
+
+        // kind: counted under this name in the variable counts, 0 for auxiliary variables
+        Var addVar(double lb, double ub, double obj, char type, char kind = 0, const string &name = "") {
+            nodeVars++;
+            if (kind != 0)
+                buildMetrics->varCounts[kind]++;
+            return model->addVar(lb, ub, obj, type, name);
+        }
+
+        void addConstr(const GRBTempConstr &constr) {
+            nodeConstrs++;
+            model->addConstr(constr);
+        }
+
+        void startNode() {
+            nodeVars = 0;
+            nodeConstrs = 0;
+            nodeTimer = {};
+        }
+
+        void finishNode(const string &operation, int vertex, unsigned int bagSize, const unordered_map<PP, GRBLinExpr> &c_exprNew) {
+            auto sequence = buildMetrics->nodeSequence++;
+            if (buildMetrics->registry == nullptr)
+                return;
+            size_t activePatterns = std::count_if(c_exprNew.begin(), c_exprNew.end(), [](const auto &e) {return !isZero(e.second);});
+            buildMetrics->registry->addNode({sequence, operation, vertex, bagSize, activePatterns, nodeVars, nodeConstrs,
+                                             nodeTimer.get<std::chrono::duration<double>>().count()});
+        }
+
+        static double upperBound(const unordered_map<PP, double> &ub, const PP &pp) {
+            auto it = ub.find(pp);
+            return it == ub.end() ? 0 : it->second;
+        }
+
+        // the count variable of each pattern of c_rhs; patterns whose count is 0, proven to be 0 by the propagated bound
+        // ub_rhs, or not admissible, are left out of c_exprNew, so that only the active patterns are carried to the next node
+        void countVariables(const unordered_map<PP, GRBLinExpr> &c_rhs, const unordered_map<PP, double> &ub_rhs, const BagRules &rules,
+                            unordered_map<PP, GRBLinExpr> &c_exprNew, unordered_map<PP, double> &c_ubNew) {
+            for (const auto& [pp, r] : c_rhs){
+                if (isZero(r))
+                    continue;
+                if (!rules.admissible(pp)) {
+                    buildMetrics->excludedPatterns++;
+                    addConstr(r == 0);
+                    continue;
+                }
+                auto ub = std::min(upperBound(ub_rhs, pp), rules.capacityBound(pp));
+                if (ub <= 0) {
+                    buildMetrics->prunedVars++;
+                    addConstr(r == 0);
+                } else {
+                    auto var = addVar(0, ub, 0, GRB_INTEGER);
+                    addConstr(r == var);
+                    c_exprNew[pp] = var;
+                    c_ubNew[pp] = ub;
+                }
+            }
+        }
+
+        // a variable with upper bound ub is only needed if ub > 0
+        bool keep(double ub) {
+            if (ub > 0)
+                return true;
+            buildMetrics->prunedVars++;
+            return false;
+        }
+
     public:
-        NiceVisitor(const Instance *instance, GRBModel *model, const Options *options) : instance(instance), model(model), options(options), rTree(make_shared<typename ReconstructionTree::Leaf>()) {}
+        NiceVisitor(const Instance *instance, GRBModel *model, const Options *options, BuildMetrics *buildMetrics, const unordered_map<int,char> *slots)
+            : instance(instance), model(model), options(options), buildMetrics(buildMetrics), vertexRenaming(slots), rTree(make_shared<typename ReconstructionTree::Leaf>()) {}
 
         NiceVisitor(const NiceVisitor&) = delete;
 
@@ -421,87 +516,99 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         void introduce(int v){
             //std::cout << "introduce node: " << vertices.size() << "+1" << endl;
             //std::cout << "introducing: " << v << endl;
+            startNode();
 
             auto rTree = make_shared<typename ReconstructionTree::Introduce>();
             rTree->vertex = v;
             rTree->child = this->rTree;
             this->rTree = rTree;
 
-            auto ppsNew = PP::allPatterns(vertices.size()+1);
             vertexRenaming.add(v);
+            introduced.insert(v);
+            auto bagNew = vertices;
+            bagNew.insert(v);
+            BagRules rules(*instance, bagNew, introduced, vertexRenaming, options->maxPatternGaps);
 
+            // only patterns reached from the active patterns of the child, or by a new line, get a row
             unordered_map<PP, GRBLinExpr> c_exprNew;
+            unordered_map<PP, double> c_ubNew;
             unordered_map<PP, GRBLinExpr> c_rhs;
-            for (const auto& pp : ppsNew){
-                c_rhs[pp] = GRBLinExpr{};
-            }
-
+            unordered_map<PP, double> ub_rhs; // sum of the upper bounds of the positive terms of c_rhs
             for (const auto& [pp, var] : c_expr){
-                c_rhs.at(pp) += var;
+                c_rhs[pp] += var;
+                ub_rhs[pp] += upperBound(c_ub, pp);
             }
 
             //introduce
             for (auto u : vertices){
+                if (!rules.isAdjacent(vertexRenaming[u], vertexRenaming[v]))
+                    continue;
                 auto pp = PP{std::array<char,2>{vertexRenaming[u], vertexRenaming[v]}};
-                auto var = model->addVar(0, GRB_INFINITY, instance->c_fix, GRB_INTEGER);
-                varCounts['i']++;
+                auto ub = rules.capacityBound(pp);
+                if (!keep(ub))
+                    continue;
+                auto var = addVar(0, ub, instance->c_fix, GRB_INTEGER, 'i');
                 rTree->i_vars.push_back({pp, var});
-                c_rhs.at(pp) += var;
+                c_rhs[pp] += var;
+                ub_rhs[pp] += ub;
             }
 
             //extend
             for (const auto& [pp, var] : c_expr){
                 for (auto extension : pp.extensions(vertexRenaming[v])){
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
-                    varCounts['e']++;
+                    if (!rules.isGraphConsistent(extension))
+                        continue;
+                    auto ub = std::min(upperBound(c_ub, pp), rules.capacityBound(extension));
+                    if (!keep(ub))
+                        continue;
+                    auto var = addVar(0, ub, 0, GRB_INTEGER, 'e');
                     rTree->e_vars.push_back({pp, extension, var});
-                    c_rhs.at(extension) += var;
-                    c_rhs.at(pp) -= var;
+                    c_rhs[extension] += var;
+                    c_rhs[pp] -= var;
+                    ub_rhs[extension] += ub;
                 }
             }
 
             //subdivide
             for (const auto& [pp, _] : c_expr){
                 for (auto sub : pp.subdivisions(vertexRenaming[v])){
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
-                    varCounts['s']++;
+                    if (!rules.isGraphConsistent(sub))
+                        continue;
+                    auto ub = std::min(upperBound(c_ub, pp), rules.capacityBound(sub));
+                    if (!keep(ub))
+                        continue;
+                    auto var = addVar(0, ub, 0, GRB_INTEGER, 's');
                     rTree->s_vars.push_back({pp, sub, var});
-                    c_rhs.at(sub) += var;
-                    c_rhs.at(pp) -= var;
+                    c_rhs[sub] += var;
+                    c_rhs[pp] -= var;
+                    ub_rhs[sub] += ub;
                 }
             }
 
-            for (const auto& [pp, r] : c_rhs){
-                if (!isZero(r)) {
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
-                    model->addConstr(r == var);
-                    c_exprNew[pp] = var;
-                } else {
-                    c_exprNew[pp] = 0;
-                }
-            }
+            countVariables(c_rhs, ub_rhs, rules, c_exprNew, c_ubNew);
 
             vertices.insert(v);
+            finishNode("introduce", v, vertices.size(), c_exprNew);
             c_expr = c_exprNew;
+            c_ub = c_ubNew;
         }
         void forget(int v){
             //std::cout << "forget node: " << vertices.size() << "-1" << endl;
             //std::cout << "forgetting: " << v << endl;
+            startNode();
 
             auto rTree = make_shared<typename ReconstructionTree::Forget>();
             rTree->vertex = v;
             rTree->child = this->rTree;
             this->rTree = rTree;
 
-            auto ppsNew = PP::allPatterns(vertices.size()-1);
-            unordered_map<PP, GRBLinExpr> c_exprNew;
-            unordered_map<PP, GRBLinExpr> c_rhs;
-            for (const auto& pp : ppsNew){
-                c_rhs[pp] = GRBLinExpr{};
-            }
             vertices.erase(v);
 
-            auto translate = vertexRenaming.renamingCausedByErase(v);
+            BagRules rules(*instance, vertices, introduced, vertexRenaming, options->maxPatternGaps);
+            unordered_map<PP, GRBLinExpr> c_exprNew;
+            unordered_map<PP, double> c_ubNew;
+            unordered_map<PP, GRBLinExpr> c_rhs;
+            unordered_map<PP, double> ub_rhs;
 
             if (options->allowCycles){
                 for (const auto& [pp, cv] : c_expr){
@@ -509,14 +616,19 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
                         continue;
                     if (!endsWith(pp, vertexRenaming[v]))
                         continue;
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
+                    auto ends = endings(pp);
+                    auto otherEnd = ends[0] == vertexRenaming[v] ? ends[1] : ends[0];
+                    if (instance->graph.findEdge(vertexRenaming.inverse(otherEnd), v) == nullptr)
+                        continue; // closing the cycle needs this edge
+                    if (!keep(upperBound(c_ub, pp)))
+                        continue;
+                    auto var = addVar(0, upperBound(c_ub, pp), 0, GRB_INTEGER);
                     rTree->cycle_vars.push_back({pp, var});
 
-                    model->addConstr(var <= cv);
+                    addConstr(var <= cv);
 
                     auto ppn = pp.forget(vertexRenaming[v]);
-                    auto ppnn = ppn.value().rename(translate);
-                    c_rhs[ppnn] -= var;
+                    c_rhs[ppn.value()] -= var;
                 }
             }
 
@@ -537,14 +649,14 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
                 auto edge = instance->graph.findEdge(u, v);
                 if (edge == nullptr)
                 {
-                    model->addConstr(expr == 0);
+                    if (!isZero(expr))
+                        addConstr(expr == 0);
                 }
                 else
                 {
                     auto vName = "f_"+to_string(u)+"_"+to_string(v);
-                    auto var = model->addVar(edge->weight.f_min, edge->weight.f_max, edge->weight.cost, GRB_INTEGER, vName);
-                    varCounts['f']++;
-                    model->addConstr(expr == var);
+                    auto var = addVar(edge->weight.f_min, edge->weight.f_max, edge->weight.cost, GRB_INTEGER, 'f', vName);
+                    addConstr(expr == var);
                 }
             }
 
@@ -552,94 +664,98 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
                 auto ppn = cv.first.forget(vertexRenaming[v]);
                 if (ppn.has_value())
                 {
-                    auto ppnn = ppn.value().rename(translate);
-                    c_rhs[ppnn] += cv.second;
+                    c_rhs[ppn.value()] += cv.second;
+                    ub_rhs[ppn.value()] += upperBound(c_ub, cv.first);
                 }
             }
 
-            for (const auto& [pp, r] : c_rhs){
-                if (!isZero(r)) {
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
-                    model->addConstr(r == var);
-                    c_exprNew[pp] = var;
-                } else {
-                    c_exprNew[pp] = 0;
-                }
-            }
+            countVariables(c_rhs, ub_rhs, rules, c_exprNew, c_ubNew);
 
             vertexRenaming.erase(v);
+            finishNode("forget", v, vertices.size()+1, c_exprNew);
             c_expr = c_exprNew;
+            c_ub = c_ubNew;
         }
 
         void merge(const NiceVisitor &other)
         {
             //std::cout << "join node: " << vertices.size() << endl;
+            startNode();
 
             auto rTree = make_shared<typename ReconstructionTree::Join>();
             rTree->child1 = this->rTree;
             rTree->child2 = other.rTree;
             this->rTree = rTree;
 
-            auto ppsNew = PP::allPatterns(vertices.size());
+            introduced.insert(other.introduced.begin(), other.introduced.end());
+            BagRules rules(*instance, vertices, introduced, vertexRenaming, options->maxPatternGaps);
             unordered_map<PP, GRBLinExpr> c_exprNew;
+            unordered_map<PP, double> c_ubNew;
             unordered_map<PP, GRBLinExpr> c_rhs;
+            unordered_map<PP, double> ub_rhs;
             unordered_map<PP, GRBLinExpr> c_unjoined_1_rhs;
             unordered_map<PP, GRBLinExpr> c_unjoined_2_rhs;
-            for (const auto& pp : ppsNew){
-                c_rhs[pp] = GRBLinExpr{};
-                c_unjoined_1_rhs[pp] = GRBLinExpr{};
-                c_unjoined_2_rhs[pp] = GRBLinExpr{};
-            }
-
-            auto translate = [this, &other](char c){
-                return vertexRenaming[other.vertexRenaming.inverse(c)];
-            };
 
             for (const auto& [pp,v] : c_expr){
                 c_unjoined_1_rhs[pp] += v;
             }
+            // both visitors use the same slots, so their patterns are comparable without translation
+            using VertexSequence = decltype(std::declval<PP>().vertexSequence());
+            unordered_map<VertexSequence, vector<PP>> byVertexSequence2;
             for (const auto& [pp,v] : other.c_expr){
-                auto ppt = pp.rename(translate);
-                c_unjoined_2_rhs[ppt] += v;
+                c_unjoined_2_rhs[pp] += v;
+                byVertexSequence2[pp.vertexSequence()].push_back(pp);
             }
 
-            for (const auto& [pp,v] : c_expr){
-                for (const auto& [pp1, pp2] : pp.joins()){
-                    if (!isZero(c_unjoined_1_rhs[pp1]) && !isZero(c_unjoined_2_rhs[pp2])){
-                        auto var = model->addVar(0, GRB_INFINITY, -instance->c_fix, GRB_INTEGER);
-                        varCounts['j']++;
-                        rTree->j_vars.push_back({pp1, pp2, pp, var});
-                        c_rhs[pp] += var;
-                        c_unjoined_1_rhs[pp1] -= var;
-                        c_unjoined_2_rhs[pp2] -= var;
-                    }
+            // a join pairs an active pattern of each child with the same proper vertices
+            unordered_set<PP> joined1, joined2;
+            for (const auto& [pp1, _] : c_expr){
+                auto it = byVertexSequence2.find(pp1.vertexSequence());
+                if (it == byVertexSequence2.end())
+                    continue;
+                for (const auto& pp2 : it->second){
+                    auto pp = pp1.join(pp2);
+                    if (!pp.has_value() || !rules.isGraphConsistent(*pp) || !rules.admissible(*pp))
+                        continue;
+                    auto ub = std::min({upperBound(c_ub, pp1), upperBound(other.c_ub, pp2), rules.capacityBound(*pp)});
+                    if (!keep(ub))
+                        continue;
+                    auto var = addVar(0, ub, -instance->c_fix, GRB_INTEGER, 'j');
+                    rTree->j_vars.push_back({pp1, pp2, *pp, var});
+                    c_rhs[*pp] += var;
+                    ub_rhs[*pp] += ub;
+                    c_unjoined_1_rhs[pp1] -= var;
+                    c_unjoined_2_rhs[pp2] -= var;
+                    joined1.insert(pp1);
+                    joined2.insert(pp2);
                 }
             }
 
-            for (const auto& pp : ppsNew){
-                c_rhs[pp] += c_unjoined_1_rhs[pp];
-                c_rhs[pp] += c_unjoined_2_rhs[pp];
-                model->addConstr(c_unjoined_1_rhs[pp] >= 0);
-                model->addConstr(c_unjoined_2_rhs[pp] >= 0);
+            // a pattern without joins stays unjoined, its count is nonnegative anyway
+            for (const auto& [pp, r] : c_unjoined_1_rhs){
+                c_rhs[pp] += r;
+                ub_rhs[pp] += upperBound(c_ub, pp);
+                if (joined1.contains(pp))
+                    addConstr(r >= 0);
             }
-
-            for (const auto& [pp, r] : c_rhs){
-                if (!isZero(r)) {
-                    auto var = model->addVar(0, GRB_INFINITY, 0, GRB_INTEGER);
-                    model->addConstr(r == var);
-                    c_exprNew[pp] = var;
-                } else {
-                    c_exprNew[pp] = 0;
-                }
+            for (const auto& [pp, r] : c_unjoined_2_rhs){
+                c_rhs[pp] += r;
+                ub_rhs[pp] += upperBound(other.c_ub, pp);
+                if (joined2.contains(pp))
+                    addConstr(r >= 0);
             }
 
+            countVariables(c_rhs, ub_rhs, rules, c_exprNew, c_ubNew);
+
+            finishNode("merge", -1, vertices.size(), c_exprNew);
             c_expr = c_exprNew;
+            c_ub = c_ubNew;
         }
 
-        auto reconstruct() const{
+        auto reconstruct(const SparseSolution &solution) const{
             MappedPathCollection<PP> mpc;
-            VertexRenaming<int,char> vr;
-            rTree->reconstruct(mpc, vr);
+            SlotRenaming<int,char> vr{vertexRenaming.getSlots()};
+            rTree->reconstruct(mpc, vr, solution);
             return mpc;
         }
     };
@@ -653,21 +769,44 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
     GRBModel model(env);
     static GRBModel* model_ptr = &model;
 
+    BuildMetrics buildMetrics;
+    buildMetrics.registry = options.metrics;
     Timer timerConsILP;
+    Metrics::StageTimer stageConsILP(options.metrics, "model build");
+    unordered_map<int,char> slots;
+    for (auto [v, slot] : td.slotAssignment()) {
+        slots[v] = slot;
+    }
     NiceVisitor finishedVisitor = td.niceVisit([&](){
-        return NiceVisitor(&instance, &model, &options);
+        return NiceVisitor(&instance, &model, &options, &buildMetrics, &slots);
         }, true);
+    stageConsILP.stop();
     cout << "time to construct ILP: " << timerConsILP.get_string() << endl;
 
     cout << "variable counts:" << endl;
-    for (auto [c, count] : varCounts) {
+    for (auto [c, count] : buildMetrics.varCounts) {
         cout << "  " << c << ": " << count << endl;
+        if (options.metrics != nullptr)
+            options.metrics->setValue(string("vars_")+c, count);
+    }
+    cout << "variables with upper bound 0 (not created): " << buildMetrics.prunedVars << endl;
+    if (options.metrics != nullptr)
+        options.metrics->setValue("vars_pruned", buildMetrics.prunedVars);
+    if (options.maxPatternGaps >= 0) {
+        cout << "patterns beyond the gap limit " << options.maxPatternGaps << " (forced to 0): " << buildMetrics.excludedPatterns << endl;
+        if (options.metrics != nullptr)
+            options.metrics->setValue("patterns_excluded", buildMetrics.excludedPatterns);
     }
 
     auto timeLimit = options.maxSolveTimeILP;
 
     constexpr bool cache_solution = false;
     model.update();
+    if (options.metrics != nullptr) {
+        options.metrics->setValue("num_vars", model.get(GRB_IntAttr_NumVars));
+        options.metrics->setValue("num_constrs", model.get(GRB_IntAttr_NumConstrs));
+        options.metrics->setValue("num_nzs", model.get(GRB_DoubleAttr_DNumNZs));
+    }
     int model_fingerprint = model.get(GRB_IntAttr_Fingerprint);
     if (cache_solution)
     {
@@ -704,6 +843,7 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
     SignalThing sh{};
 
     Timer timerSolver;
+    Metrics::StageTimer stageSolver(options.metrics, "solve");
 
     bool outputPresolved = false;
     if (outputPresolved){
@@ -713,7 +853,10 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
     }
 
     model.optimize();
+    stageSolver.stop();
     auto optimstatus = model.get(GRB_IntAttr_Status);
+    if (options.metrics != nullptr)
+        options.metrics->setValue("status", optimstatus);
     if (optimstatus == GRB_OPTIMAL) {
         if (cache_solution)
         {
@@ -726,7 +869,7 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
         cout << "optimization was stopped with status = " << optimstatus << endl;
     }
     if (optimstatus == GRB_INFEASIBLE) {
-        throw InfeasibleInstanceError("instance is infeasible");
+        throw InfeasibleInstanceError(options.maxPatternGaps < 0 ? "instance is infeasible" : "instance is infeasible with the pattern gap limit");
     }
     cout << "MIPGap: " << model.get(GRB_DoubleAttr_MIPGap) << endl;
 #ifndef NDEBUG
@@ -743,18 +886,54 @@ LinePlanning::LineConcept _solve(const Instance& instance, const TreeDecompositi
     cout << "time to solve ILP: " << timerSolver.get_string() << endl;
     auto objVal = model.get(GRB_DoubleAttr_ObjVal);
     cout << "objective value: " << objVal << endl;
+    reportPatternGapLimit(options);
 
     Timer timerRecons;
-    auto rec = finishedVisitor.reconstruct();
+    Metrics::StageTimer stageRecons(options.metrics, "reconstruction");
+    SparseSolution solution(model);
+    if (solution.roundedCount > 0) {
+        cout << "warning: rounded " << solution.roundedCount << " non-integer values from Gurobi (largest deviation: " << solution.largestDeviation << ")" << endl;
+    }
+    if (options.metrics != nullptr) {
+        options.metrics->setValue("rounded_values", solution.roundedCount);
+        options.metrics->setValue("largest_rounding", solution.largestDeviation);
+    }
+    auto rec = finishedVisitor.reconstruct(solution);
     auto lc = rec.toLC(&instance);
+    stageRecons.stop();
     cout << "time to create line concept from solution: " << timerRecons.get_string() << endl;
+    if (options.metrics != nullptr) {
+        options.metrics->setValue("objective", objVal);
+        options.metrics->setValue("mip_gap", model.get(GRB_DoubleAttr_MIPGap));
+    }
+    if (options.localSearchTime > 0) {
+        Metrics::StageTimer stageLocalSearch(options.metrics, "local search");
+        auto improved = improveLocally(instance, lc, {options.localSearchTime});
+        stageLocalSearch.stop();
+        cout << "local search: cost " << improved.costBefore << " -> " << improved.costAfter << " (" << improved.moves << " moves)" << endl;
+        if (options.metrics != nullptr)
+            options.metrics->setValue("local_search_improvement", improved.costBefore-improved.costAfter);
+        lc = std::move(improved.lineConcept);
+    }
     return lc;
 }
 
 
 LinePlanning::LineConcept solve(const Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options) {
+    if (selectBackend(instance, td, options) == Backend::DP) {
+        cout << "using the dynamic program backend" << endl;
+        return solveDP(instance, td, options);
+    }
     auto requestedBagSize = td.getLargestBagSize();
 
+    if (options.memoryBudgetMB > 0) {
+        auto estimate = estimateModelSize(instance, td, options);
+        if (estimate.memoryMB > options.memoryBudgetMB) {
+            throw ModelTooLargeError("predicted model size of " + to_string((long long)estimate.memoryMB) + " MB exceeds the memory budget of "
+                    + to_string((long long)options.memoryBudgetMB) + " MB", estimate);
+        }
+    }
+
     typedef PathPatternOptimized<unsigned int> PP1;
     typedef PathPatternOptimized<unsigned long long> PP2;
     //typedef PathPatternOptimized<std::bitset<128>> PP3;
@@ -1,24 +1,77 @@
 
-#ifndef LINEPLANNING_SOLVER_H
-#define LINEPLANNING_SOLVER_H
+#ifndef LINEPLANNING_TW2ILP_SOLVER_H
+#define LINEPLANNING_TW2ILP_SOLVER_H
 
 #include "../LinePlanning.h"
 #include "../TreeDecomposition.h"
+#include "../Metrics.h"
 #include <cmath>
 
 namespace Solver{
 
+    enum class Backend {
+        AUTO, // DP for small width and frequencies, ILP otherwise; forests are solved by solveForest before any decomposition
+        ILP, // Gurobi model over path patterns
+        DP // exact dynamic program over path schemes (../Solver.h), needs no Gurobi licence but only suits tiny instances
+    };
+
     struct Options {
         double maxSolveTimeILP = std::numeric_limits<double>::infinity();
         double MIPGap = -1;
         bool allowPaths = true;
         bool allowCycles = false;
         bool enableSpecializedTD = true;
+        TreeDecomposition::Strategy tdStrategy = TreeDecomposition::Strategy::AUTO;
+        int pathwidthSlack = -1; // a path decomposition is used if its width exceeds the treewidth by at most this, negative to never
+        // experimental: only path patterns with at most this many squares between their ends are modelled (ILP and DP),
+        // which shrinks the pattern space but makes the result optimal only among such line concepts; negative for no limit
+        int maxPatternGaps = -1;
         bool enableVisualization = true;
+        Metrics::Registry *metrics = nullptr; // receives stage times, per-node records and model sizes if set
+        double memoryBudgetMB = 0; // solve refuses decompositions whose predicted model exceeds this, 0 for no limit
+        double localSearchTime = 0; // seconds of local search on the reconstructed line concept, 0 to skip it
+        Backend backend = Backend::AUTO;
+        unsigned int dpMaxWidth = 2; // Backend::AUTO uses the DP up to this treewidth ...
+        unsigned int dpMaxFrequency = 2; // ... if no edge has a larger f_max
+        unsigned int dpThreads = 0; // threads of the DP, 0 for one per hardware thread; the result does not depend on it
+    };
+
+    // predicted size of the ILP built by solve: the active path patterns are propagated through the decomposition by the
+    // rules of the model construction, without building the model
+    struct ModelSizeEstimate {
+        double vars = 0;
+        double constrs = 0;
+        double nonzeros = 0;
+        double memoryMB = 0; // rough, model plus the pattern maps of the largest node
+        unsigned int largestBagSize = 0;
+        bool complete = true; // false if the propagation stopped at Options::memoryBudgetMB, the sizes are then lower bounds
     };
 
+    // as expensive as the pattern propagation of the model construction, but stops early at Options::memoryBudgetMB
+    ModelSizeEstimate estimateModelSize(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options);
+
+    class ModelTooLargeError : public std::runtime_error{
+    public:
+        ModelSizeEstimate estimate;
+        ModelTooLargeError(const std::string& msg, ModelSizeEstimate estimate) : std::runtime_error(msg), estimate(estimate) {}
+    };
+
+    // the backend that solve uses for Options::backend, resolves Backend::AUTO
+    Backend selectBackend(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options);
+
+    // with Options::maxPatternGaps the objective (and the MIPGap) only refer to the restricted pattern family: warns about it
+    // and records it in the metrics, does nothing without a limit
+    void reportPatternGapLimit(const Options &options);
+
+    // the DP backend, paths only
+    LinePlanning::LineConcept solveDP(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options);
+
+    // the tree DP (../TreeSolver.h) for networks that are forests, linear in the size of the network
+    LinePlanning::LineConcept solveForest(const LinePlanning::Instance& instance, const Options &options);
+
+    // throws ModelTooLargeError if the predicted model exceeds Options::memoryBudgetMB
     LinePlanning::LineConcept solve(const LinePlanning::Instance& instance, const TreeDecomposition::TreeDecomposition& td, const Options &options);
 }
 
 
-#endif //LINEPLANNING_SOLVER_H
+#endif //LINEPLANNING_TW2ILP_SOLVER_H
@@ -1,41 +1,132 @@
 #include <iostream>
 #include <filesystem>
+#include <optional>
 #include "Solver.h"
 #include "../DataParser.h"
 #include "../Graphics.h"
+#include "../TreeSolver.h"
+#include "../SpecializedTD.h"
 
 using namespace LinePlanning;
 using namespace std;
 using filesystem::path;
 
-auto solve(Project &project, Solver::Options options, bool writeLinePool = false)
+TreeDecomposition::Coordinates loadCoordinates(const Project &project)
 {
-    Instance instance = project.parseInstanceFiles();
-    if (!filesystem::exists(project.output_folder)) {
-        filesystem::create_directory(project.output_folder);
+    TreeDecomposition::Coordinates coordinates;
+    ifstream stopFile(project.input_folder / "Stop.giv");
+    if (stopFile) {
+        for (auto &[stop, info] : parseNodeInfo(stopFile)) {
+            coordinates[stop] = {info.x, info.y};
+        }
     }
-    if (!filesystem::exists(project.output_folder / "out.td"))
-    {
-        cout << "computing tree decomposition" << endl;
-        TreeDecomposition::compute(TreeDecomposition::convert(instance.graph), project.output_folder / "out.td", options.enableSpecializedTD);
+    return coordinates;
+}
+
+TreeDecomposition::ComputeOptions tdOptions(const Solver::Options &options, TreeDecomposition::Strategy strategy, const TreeDecomposition::Coordinates &coordinates)
+{
+    TreeDecomposition::ComputeOptions tdOptions;
+    tdOptions.enableSpecializedAlgorithms = options.enableSpecializedTD;
+    tdOptions.strategy = strategy;
+    tdOptions.coordinates = coordinates.empty() ? nullptr : &coordinates;
+    return tdOptions;
+}
+
+void printEstimate(const Solver::ModelSizeEstimate &estimate)
+{
+    cout << "predicted model size" << (estimate.complete ? "" : " (at least, stopped at the memory budget)") << ": " << (long long)estimate.vars << " variables, " << (long long)estimate.constrs << " constraints, "
+         << (long long)estimate.nonzeros << " nonzeros, ~" << (long long)estimate.memoryMB << " MB" << endl;
+}
+
+// tries the other decomposition strategies and returns the one with the smallest predicted model within the budget. It is
+// kept as out-<strategy>.td, and replaces out.td only if replaceOutTd (out.td was computed by this run, not given)
+auto decompositionWithinBudget(Project &project, const Instance &instance, const Solver::Options &options, bool replaceOutTd)
+{
+    using TreeDecomposition::Strategy;
+    auto coordinates = loadCoordinates(project);
+    auto graph = TreeDecomposition::convert(instance.graph);
+    vector<pair<Strategy, string>> candidates;
+    if (options.tdStrategy != Strategy::AUTO && options.tdStrategy != Strategy::EXACT && graph.vertexCount < TreeDecomposition::ComputeOptions{}.sweepVertexThreshold)
+        candidates.push_back({Strategy::EXACT, "exact"});
+    if (!coordinates.empty()) {
+        if (options.tdStrategy != Strategy::SEPARATOR)
+            candidates.push_back({Strategy::SEPARATOR, "separator"});
+        if (options.tdStrategy != Strategy::SWEEP)
+            candidates.push_back({Strategy::SWEEP, "sweep"});
     }
-    else
-    {
-        cout << "using existing out.td" << endl;
+
+    optional<pair<TreeDecomposition::TreeDecomposition, Solver::ModelSizeEstimate>> best;
+    path bestFile;
+    for (const auto &[strategy, name] : candidates) {
+        cout << "trying " << name << " tree decomposition" << endl;
+        auto file = project.output_folder / ("out-" + name + ".td");
+        try {
+            auto td = TreeDecomposition::compute(graph, file, tdOptions(options, strategy, coordinates));
+            auto estimate = Solver::estimateModelSize(instance, td, options);
+            cout << "treewidth: " << td.getLargestBagSize()-1 << endl;
+            printEstimate(estimate);
+            if (estimate.memoryMB <= options.memoryBudgetMB && (!best.has_value() || estimate.memoryMB < best->second.memoryMB)) {
+                best = {std::move(td), estimate};
+                bestFile = file;
+            }
+        } catch (std::runtime_error &err) {
+            cerr << err.what() << endl;
+        }
     }
-    ifstream tdfile(project.output_folder / "out.td");
-    auto td = TreeDecomposition::parse(tdfile);
-    cout << "treewidth: " << td.getLargestBagSize()-1 << endl;
+    for (const auto &[_, name] : candidates) {
+        auto file = project.output_folder / ("out-" + name + ".td");
+        if (file != bestFile)
+            filesystem::remove(file);
+    }
+    if (!best.has_value())
+        throw std::runtime_error("no tree decomposition with a predicted model size within the memory budget of " + to_string((long long)options.memoryBudgetMB) + " MB found");
+    if (replaceOutTd) {
+        filesystem::rename(bestFile, project.output_folder / "out.td");
+        cout << "using " << bestFile.filename() << " as out.td" << endl;
+    } else {
+        cout << "using " << bestFile.filename() << ", out.td is left unchanged" << endl;
+    }
+    return std::move(best->first);
+}
 
-    if (options.enableVisualization)
-        Graphics::drawTreeDecomposition(td, project.graphics_folder);
+// replaces td by a path decomposition, whose model has no join nodes, if its width exceeds the treewidth by at most
+// Options::pathwidthSlack and its ILP model fits the memory budget; prints and records the decision
+void preferPathDecomposition(Project &project, const Instance &instance, TreeDecomposition::TreeDecomposition &td, const Solver::Options &options)
+{
+    unsigned int treewidth = td.getLargestBagSize()-1;
+    bool usePath = td.isPath();
+    unsigned int pathwidth = treewidth;
+    if (usePath) {
+        cout << "the tree decomposition is a path decomposition" << endl;
+    } else {
+        auto coordinates = loadCoordinates(project);
+        auto graph = TreeDecomposition::convert(TreeDecomposition::convert(instance.graph));
+        auto pd = TreeDecomposition::pathDecomposition(graph, td, coordinates.empty() ? nullptr : &coordinates);
+        pathwidth = pd.getLargestBagSize()-1;
+        usePath = pathwidth <= treewidth + options.pathwidthSlack;
+        bool overBudget = usePath && options.memoryBudgetMB > 0 && Solver::selectBackend(instance, pd, options) == Solver::Backend::ILP
+                && Solver::estimateModelSize(instance, pd, options).memoryMB > options.memoryBudgetMB;
+        usePath = usePath && !overBudget;
+        cout << "path decomposition: width " << pathwidth << " (treewidth " << treewidth << ", slack " << options.pathwidthSlack << "), "
+             << (usePath ? "using it" : overBudget ? "keeping the tree decomposition, its model exceeds the memory budget" : "keeping the tree decomposition") << endl;
+        if (usePath)
+            td = std::move(pd);
+    }
+    if (options.metrics != nullptr) {
+        options.metrics->setValue("pathwidth", pathwidth);
+        options.metrics->setValue("path_decomposition", usePath);
+    }
+}
 
-    auto lineConcept = Solver::solve(instance, td, options);
+// checks and prints the line concept and writes the output files
+LineConcept writeSolution(Project &project, const Instance &instance, LineConcept lineConcept, const Solver::Options &options, bool writeLinePool)
+{
     cout << "feasible: " << lineConcept.isFeasible(instance, true) << endl;
     LineConcept::Costs costs = lineConcept.calcCost(instance);
     cout << "cost: " << costs.costTotal << endl;
     cout << "cost contribution cfix: " << costs.cost_cfix << endl;
     cout << "cost contribution edges: " << costs.cost_edges << endl;
+    Metrics::StageTimer stageOutput(options.metrics, "output");
     outputLineConcept(project.output_folder / "Line-Concept.lin", lineConcept);
     cout << "output file: " << project.output_folder / "Line-Concept.lin" << endl;
 
@@ -45,9 +136,76 @@ auto solve(Project &project, Solver::Options options, bool writeLinePool = false
         outputPoolCosts(project.input_folder / "Pool-Cost.giv", instance, lineConcept);
         cout << "output file: " << project.input_folder / "Pool-Cost.giv" << endl;
     }
+    stageOutput.stop();
+    if (options.metrics != nullptr)
+        options.metrics->setValue("cost", costs.costTotal);
     return lineConcept;
 }
 
+optional<LineConcept> solve(Project &project, Solver::Options options, bool dryRun = false, bool writeLinePool = false)
+{
+    Metrics::StageTimer stageParse(options.metrics, "parse");
+    Instance instance = project.parseInstanceFiles();
+    stageParse.stop();
+    if (!filesystem::exists(project.output_folder)) {
+        filesystem::create_directory(project.output_folder);
+    }
+    if (options.backend == Solver::Backend::AUTO && !dryRun && TreeSolver::isForest(instance.graph)) {
+        cout << "network is a forest, solving it without tree decomposition" << endl;
+        if (options.metrics != nullptr)
+            options.metrics->setValue("treewidth", 1);
+        return writeSolution(project, instance, Solver::solveForest(instance, options), options, writeLinePool);
+    }
+
+    Metrics::StageTimer stageTD(options.metrics, "tree decomposition");
+    bool computedTD = !filesystem::exists(project.output_folder / "out.td");
+    if (computedTD)
+    {
+        cout << "computing tree decomposition" << endl;
+        auto coordinates = loadCoordinates(project);
+        TreeDecomposition::compute(TreeDecomposition::convert(instance.graph), project.output_folder / "out.td", tdOptions(options, options.tdStrategy, coordinates));
+    }
+    else
+    {
+        cout << "using existing out.td" << endl;
+    }
+    ifstream tdfile(project.output_folder / "out.td");
+    auto td = TreeDecomposition::parse(tdfile);
+    tdfile.close();
+    cout << "treewidth: " << td.getLargestBagSize()-1 << endl;
+    if (options.pathwidthSlack >= 0)
+        preferPathDecomposition(project, instance, td, options);
+
+    if (options.memoryBudgetMB > 0 || dryRun) {
+        auto estimate = Solver::estimateModelSize(instance, td, options);
+        printEstimate(estimate);
+        // the budget only concerns the ILP, the DP does not build this model
+        if (options.memoryBudgetMB > 0 && estimate.memoryMB > options.memoryBudgetMB && Solver::selectBackend(instance, td, options) == Solver::Backend::ILP) {
+            cout << "predicted model exceeds the memory budget of " << options.memoryBudgetMB << " MB" << endl;
+            td = decompositionWithinBudget(project, instance, options, computedTD);
+            if (options.pathwidthSlack >= 0)
+                preferPathDecomposition(project, instance, td, options);
+            estimate = Solver::estimateModelSize(instance, td, options);
+        }
+        if (options.metrics != nullptr) {
+            options.metrics->setValue("predicted_vars", estimate.vars);
+            options.metrics->setValue("predicted_constrs", estimate.constrs);
+            options.metrics->setValue("predicted_nzs", estimate.nonzeros);
+            options.metrics->setValue("predicted_memory_mb", estimate.memoryMB);
+        }
+    }
+    stageTD.stop();
+    if (options.metrics != nullptr)
+        options.metrics->setValue("treewidth", td.getLargestBagSize()-1);
+    if (dryRun)
+        return {};
+
+    if (options.enableVisualization)
+        Graphics::drawTreeDecomposition(td, project.graphics_folder);
+
+    return writeSolution(project, instance, Solver::solve(instance, td, options), options, writeLinePool);
+}
+
 int main(int argc, char** argv) {
 
     TreeDecomposition::TD_App_Classpath = (path(argv[0]).parent_path().parent_path() / TreeDecomposition::TD_App_Classpath).string();
@@ -60,12 +218,25 @@ int main(int argc, char** argv) {
         cout << "optional parameters:" << endl;
         cout << "  -t<value>: time limit for ILP solving, in seconds" << endl;
         cout << "  -mg<value>: relative MIP optimality gap (Gurobi MIPGap)" << endl;
+        cout << "  -ls<value>: improve the line concept by local search for up to <value> seconds (useful with -t or -mg)" << endl;
         cout << "  -td-default: disable specialized tree decomposition algorithms" << endl;
+        cout << "  -td-sweep: tree decomposition by sweeping along the stop coordinates (fast, not optimal)" << endl;
+        cout << "  -td-exact: never use the coordinate sweep (by default used for large networks)" << endl;
+        cout << "  -td-separator: tree decomposition by recursive geometric separators along the stop coordinates" << endl;
+        cout << "  -td-path<value>: use a path decomposition (no join nodes) if its width exceeds the treewidth by at most <value>" << endl;
+        cout << "  -backend=<auto|ilp|dp>: ILP (Gurobi) or exact dynamic program, auto solves forests directly and uses the DP for treewidth <= 2 and f_max <= 2" << endl;
+        cout << "  -dp-threads<value>: threads of the dynamic program, by default one per hardware thread" << endl;
+        cout << "  -pattern-gaps<value>: experimental, only model path patterns with at most <value> inner squares (ILP and DP);" << endl;
+        cout << "                        smaller models, but the line concept is only optimal among the lines with such patterns" << endl;
         cout << "  -no-viz: disable visualization output" << endl;
+        cout << "  -mem<value>: memory budget in MB for the ILP model, other decompositions are tried if the predicted model exceeds it (a given out.td is kept)" << endl;
+        cout << "  -dry-run: only compute the tree decomposition and print the predicted model size" << endl;
+        cout << "  -metrics=<json|csv>: write stage times, memory and per-node model construction records" << endl;
         //cout << "computes the optimal line concept" << endl;
         cout << "outputs:" << endl;
         cout << "  solution:           <input_folder>/line-planning/Line-Concept.lin" << endl;
         cout << "  tree decomposition: <input_folder>/line-planning/out.td" << endl;
+        cout << "  metrics:            <input_folder>/line-planning/Metrics.json or Metrics-*.csv" << endl;
         cout << "  visualizations:" << endl;
         cout << "    line concept:     <input_folder>/graphics/line-plan.png" << endl;
         cout << "    tree decomp.:     <input_folder>/graphics/td.png" << endl;
@@ -75,11 +246,31 @@ int main(int argc, char** argv) {
     path instance_dir = argv[1];
 
     Solver::Options options;
+    string metricsFormat;
+    bool dryRun = false;
     for (int i = 2; i < argc; i++) {
         string par = argv[i];
         if (par == "-td-default") {
             options.enableSpecializedTD = false;
         }
+        else if (par == "-td-sweep") {
+            options.tdStrategy = TreeDecomposition::Strategy::SWEEP;
+        }
+        else if (par == "-td-exact") {
+            options.tdStrategy = TreeDecomposition::Strategy::EXACT;
+        }
+        else if (par == "-td-separator") {
+            options.tdStrategy = TreeDecomposition::Strategy::SEPARATOR;
+        }
+        else if (par.starts_with("-td-path")) {
+            options.pathwidthSlack = std::stoi(par.substr(8));
+        }
+        else if (par.starts_with("-dp-threads")) {
+            options.dpThreads = std::stoi(par.substr(11));
+        }
+        else if (par.starts_with("-pattern-gaps")) {
+            options.maxPatternGaps = std::stoi(par.substr(13));
+        }
         else if (par.starts_with("-t")) {
             par = par.substr(2);
             options.maxSolveTimeILP = std::stod(par);
@@ -88,8 +279,35 @@ int main(int argc, char** argv) {
             par = par.substr(3);
             options.MIPGap = std::stod(par);
         }
+        else if (par.starts_with("-ls")) {
+            options.localSearchTime = std::stod(par.substr(3));
+        }
+        else if (par.starts_with("-backend=")) {
+            auto backend = par.substr(9);
+            if (backend == "auto")
+                options.backend = Solver::Backend::AUTO;
+            else if (backend == "ilp")
+                options.backend = Solver::Backend::ILP;
+            else if (backend == "dp")
+                options.backend = Solver::Backend::DP;
+            else
+                cout << "unknown backend: " << backend << endl;
+        }
         else if (par == "-no-viz") {
             options.enableVisualization = false;
+        }
+        else if (par.starts_with("-metrics=")) {
+            metricsFormat = par.substr(9);
+            if (metricsFormat != "json" && metricsFormat != "csv") {
+                cout << "unknown metrics format: " << metricsFormat << endl;
+                metricsFormat.clear();
+            }
+        }
+        else if (par == "-dry-run") {
+            dryRun = true;
+        }
+        else if (par.starts_with("-mem")) {
+            options.memoryBudgetMB = std::stod(par.substr(4));
         } else {
             cout << "unknown parameter: " << par << endl;
         }
@@ -100,8 +318,19 @@ int main(int argc, char** argv) {
         try
         {
             Project project(instance_dir);
-            auto lineConcept = solve(project,options);
-            if (options.enableVisualization)
+            Metrics::Registry metrics;
+            if (!metricsFormat.empty())
+                options.metrics = &metrics;
+            auto lineConcept = solve(project, options, dryRun);
+            if (metricsFormat == "json") {
+                ofstream metricsFile(project.output_folder / "Metrics.json");
+                metrics.writeJSON(metricsFile);
+                cout << "output file: " << project.output_folder / "Metrics.json" << endl;
+            } else if (metricsFormat == "csv") {
+                metrics.writeCSV(project.output_folder / "Metrics");
+                cout << "output files: " << project.output_folder / "Metrics-*.csv" << endl;
+            }
+            if (options.enableVisualization && lineConcept.has_value())
                 Graphics::drawInstanceWithLineConcept(project);
             return 0;
         } catch(std::runtime_error &err)
@@ -1,6 +1,7 @@
 
 #include "TreeDecomposition.h"
 #include "SpecializedTD.h"
+#include "SeparatorTD.h"
 #include <fstream>
 #include <sstream>
 
@@ -19,13 +20,13 @@ namespace TreeDecomposition {
         }
     }
 
-    void computeWithPaces(filesystem::path in_file, filesystem::path out_file) {
+    void computeWithPaces(filesystem::path in_file, filesystem::path out_file, const std::string &jvmHeap) {
 
         auto parent = out_file.parent_path();
         if (parent != "" && !exists(parent)){
             filesystem::create_directory(parent);
         }
-        auto str = "java -cp "+TD_App_Classpath+" -Xmx8g -Xms8g -Xss10m tw.exact.MainDecomposer < "+in_file.string()+" > "+out_file.string();
+        auto str = "java -cp "+TD_App_Classpath+" -Xmx"+jvmHeap+" -Xms"+jvmHeap+" -Xss10m tw.exact.MainDecomposer < "+in_file.string()+" > "+out_file.string();
         int result = system(str.c_str());
         if (result != 0)
         {
@@ -104,7 +105,7 @@ namespace TreeDecomposition {
         return td;
     }
 
-    TreeDecomposition computeWithPaces(const EdgeListGraph &graph, filesystem::path outputFile) {
+    TreeDecomposition computeWithPaces(const EdgeListGraph &graph, filesystem::path outputFile, const std::string &jvmHeap) {
 
         class TmpFile {
             filesystem::path file;
@@ -126,12 +127,12 @@ namespace TreeDecomposition {
         g_norm.indexNormalization(ren, renInv, 1);
         g_norm.renameVertices(ren);
 
-        //TmpFile tmpFile(outputFile.parent_path() / "tw-in.gr");
-        TmpFile tmpFile("tw-in.gr");
+        // next to the output file, so that concurrent runs do not interfere
+        TmpFile tmpFile(outputFile.string()+".in.gr");
         ofstream fA((filesystem::path)tmpFile);
         g_norm.print(fA);
         fA.close();
-        computeWithPaces((filesystem::path)tmpFile, outputFile);
+        computeWithPaces((filesystem::path)tmpFile, outputFile, jvmHeap);
         ifstream fB(outputFile);
         TreeDecomposition td = parse(fB);
         fB.close();
@@ -142,11 +143,32 @@ namespace TreeDecomposition {
     }
 
     TreeDecomposition compute(const EdgeListGraph &graph, filesystem::path outputFile, bool enableSpecializedAlgorithms) {
+        ComputeOptions options;
+        options.enableSpecializedAlgorithms = enableSpecializedAlgorithms;
+        return compute(graph, outputFile, options);
+    }
+
+    TreeDecomposition compute(const EdgeListGraph &graph, filesystem::path outputFile, const ComputeOptions &options) {
+        auto g = convert(graph);
+
+        if ((options.strategy == Strategy::SWEEP || options.strategy == Strategy::SEPARATOR) && options.coordinates == nullptr)
+            throw std::runtime_error("sweep/separator tree decomposition requires stop coordinates");
+
+        if (options.strategy == Strategy::SEPARATOR) {
+            SeparatorOptions separatorOptions;
+            separatorOptions.leafSize = options.separatorLeafSize;
+            separatorOptions.threads = options.separatorThreads;
+            auto td = bySeparators(g, *options.coordinates, separatorOptions);
+            std::cout << "separator tree decomposition: width " << td.getTreeWidth() << std::endl;
+            ofstream fB(outputFile);
+            td.write(fB);
+            return td;
+        }
 
-        if (enableSpecializedAlgorithms) {
+        if (options.enableSpecializedAlgorithms && options.strategy != Strategy::SWEEP) {
             //TODO: verify TD
             try {
-                auto td = forGrid(convert(graph));
+                auto td = forGrid(g);
                 std::cout << "special tree decomposition: grid" << std::endl;
                 ofstream fB(outputFile);
                 td.write(fB);
@@ -155,13 +177,46 @@ namespace TreeDecomposition {
             }
 
             try {
-                auto td = forRings(convert(graph));
+                auto td = forRings(g);
                 std::cout << "special tree decomposition: rings" << std::endl;
                 ofstream fB(outputFile);
                 td.write(fB);
                 return td;
             } catch (WrongGraphClassError &e) {
             }
+
+            vector<Edge> deviatingEdges;
+            try {
+                auto td = forNearGrid(g, &deviatingEdges);
+                std::cout << "special tree decomposition: near-grid (" << deviatingEdges.size() << " deviating edges)" << std::endl;
+                ofstream fB(outputFile);
+                td.write(fB);
+                return td;
+            } catch (WrongGraphClassError &e) {
+            }
+
+            try {
+                auto td = forNearRings(g, &deviatingEdges);
+                std::cout << "special tree decomposition: near-rings (" << deviatingEdges.size() << " deviating edges)" << std::endl;
+                ofstream fB(outputFile);
+                td.write(fB);
+                return td;
+            } catch (WrongGraphClassError &e) {
+            }
+        }
+
+        if (options.coordinates != nullptr && (options.strategy == Strategy::SWEEP
+            || (options.strategy == Strategy::AUTO && g.nodeCount() >= options.sweepVertexThreshold))) {
+            try {
+                auto td = forCoordinates(g, *options.coordinates, options.sweepDirections);
+                std::cout << "sweep tree decomposition: width " << td.getTreeWidth() << std::endl;
+                ofstream fB(outputFile);
+                td.write(fB);
+                return td;
+            } catch (WrongGraphClassError &e) {
+                if (options.strategy == Strategy::SWEEP)
+                    throw std::runtime_error(string("sweep tree decomposition failed: ")+e.what());
+            }
         }
 
         return computeWithPaces(graph, outputFile);
@@ -212,6 +267,56 @@ namespace TreeDecomposition {
         return &bags.back();
     }
 
+    const vector<Bag> &TreeDecomposition::getBags() const {
+        return bags;
+    }
+
+    std::unordered_map<Vertex, unsigned int> TreeDecomposition::slotAssignment() const {
+        // top-down like register allocation: a bag keeps the slots of the vertices it shares with its parent
+        // and gives the smallest free slots to the others. As the bags of a vertex are connected, every vertex it
+        // shares a bag with already has its slot when the topmost of these bags is visited, or gets one afterwards.
+        std::unordered_map<Vertex, unsigned int> slots;
+        if (bags.empty())
+            return slots;
+        vector<const Bag*> stack{root()};
+        while (!stack.empty()) {
+            auto bag = stack.back();
+            stack.pop_back();
+            set<unsigned int> used;
+            for (auto v : bag->vertices) {
+                auto it = slots.find(v);
+                if (it != slots.end())
+                    used.insert(it->second);
+            }
+            unsigned int next = 1;
+            for (auto v : bag->vertices) {
+                if (slots.contains(v))
+                    continue;
+                while (used.contains(next))
+                    next++;
+                slots[v] = next;
+                used.insert(next);
+            }
+            stack.insert(stack.end(), bag->children.begin(), bag->children.end());
+        }
+        return slots;
+    }
+
+    TreeDecomposition TreeDecomposition::fromTree(const vector<set<Vertex>> &bags, const vector<int> &parents) {
+        TreeDecomposition td(bags.size());
+        unsigned int largestBag = 1;
+        for (unsigned int i = 0; i < bags.size(); i++) {
+            td.bags[i].vertices = bags[i];
+            largestBag = std::max(largestBag, (unsigned int)bags[i].size());
+            if (parents[i] >= 0) {
+                td.bags[i].parent = &td.bags[parents[i]];
+                td.bags[parents[i]].children.push_back(&td.bags[i]);
+            }
+        }
+        td.treewidth = largestBag-1;
+        return td;
+    }
+
     TreeDecomposition::TreeDecomposition(TreeDecomposition &&other) {
         treewidth = other.treewidth;
         bags = std::move(other.bags);
@@ -157,6 +157,7 @@ namespace TreeDecomposition
         friend TreeDecomposition parse(std::istream &istream);
 
         const Bag* root() const;
+        const vector<Bag>& getBags() const;
 
         template <class F>
         auto niceVisit(F leafVisitorConstructor, bool rootForgetsAll = true) const
@@ -175,6 +176,9 @@ namespace TreeDecomposition
 
         void renameVertices(const std::unordered_map<Vertex, Vertex> &renaming);
 
+        // a slot in 1..getLargestBagSize() for every vertex, distinct within each bag and the same in all bags of the vertex
+        std::unordered_map<Vertex, unsigned int> slotAssignment() const;
+
 
         void write(std::ostream &stream) const;
 
@@ -186,14 +190,18 @@ namespace TreeDecomposition
             for (auto bag : bags) {
                 td.bags[i].vertices = set<Vertex>(bag.begin(), bag.end());
                 td.treewidth = std::max(td.treewidth, (unsigned int)td.bags[i].vertices.size()-1);
+                // the root is the last bag
                 if (i > 0){
-                    td.bags[i].parent = &td.bags[i-1];
-                    td.bags[i-1].children = {&td.bags[i]};
+                    td.bags[i-1].parent = &td.bags[i];
+                    td.bags[i].children = {&td.bags[i-1]};
                 }
                 i++;
             }
             return td;
         }
+
+        // parents[i] is the index of the parent bag of bag i (-1 for the root), the root has to be the last bag
+        static TreeDecomposition fromTree(const vector<set<Vertex>> &bags, const vector<int> &parents);
     };
 
     template <class T>
@@ -249,7 +257,30 @@ namespace TreeDecomposition
         return elg;
     }*/
 
+    typedef std::unordered_map<Vertex, std::pair<double, double>> Coordinates;
+
+    enum class Strategy {
+        AUTO,  // like EXACT, but large graphs with coordinates are decomposed by a coordinate sweep
+        EXACT, // specialized algorithms (if enabled), then the PACE exact solver
+        SWEEP, // coordinate sweep, requires coordinates
+        SEPARATOR, // recursive geometric separators, small pieces by the PACE exact solver, requires coordinates
+    };
+
+    struct ComputeOptions {
+        bool enableSpecializedAlgorithms = true;
+        Strategy strategy = Strategy::AUTO;
+        const Coordinates *coordinates = nullptr;
+        unsigned int sweepVertexThreshold = 2000; // AUTO: graphs with at least this many vertices are decomposed by sweep
+        unsigned int sweepDirections = 8;
+        unsigned int separatorLeafSize = 100; // SEPARATOR: pieces up to this many vertices are decomposed exactly
+        unsigned int separatorThreads = 0; // SEPARATOR: pieces decomposed at once, 0 for one per hardware thread
+    };
+
+    // runs the PACE exact solver, the result is also written to outputFile
+    TreeDecomposition computeWithPaces(const EdgeListGraph &graph, std::filesystem::path outputFile, const std::string &jvmHeap = "8g");
+
     TreeDecomposition compute(const EdgeListGraph &graph, std::filesystem::path outputFile, bool enableSpecializedAlgorithms);
+    TreeDecomposition compute(const EdgeListGraph &graph, std::filesystem::path outputFile, const ComputeOptions &options);
 }
 
 
@@ -2,6 +2,11 @@
 #include "TreeSolver.h"
 #include <map>
 #include <set>
+#include <limits>
+#include <atomic>
+#include <future>
+#include <algorithm>
+#include <span>
 
 using namespace std;
 
@@ -14,106 +19,229 @@ namespace LinePlanning
         OptimaTable leafTable()
         {
             OptimaTable ot(0);
-            ot[0] = {0,{}};
+            ot[0] = {0};
             return ot;
         }
 
-        OptimaTable introduceParentNode(const OptimaTable &childTable, const EdgeInfo &edge, unsigned int edgeIndex, real c_fix)
+        OptimaTable introduceParentNode(const OptimaTable &childTable, const EdgeInfo &edge, real c_fix)
         {
             OptimaTable parentIntroductionTable(edge.f_max);
+            // the admissible l grow with k, so the minimum over them is a running prefix minimum
+            real t2 = std::numeric_limits<real>::max();
+            unsigned int best_l = 0;
+            unsigned int next_l = 0;
+            real savings = 0;
             for (unsigned int k = 0; k <= parentIntroductionTable.getMaximalK(); k++)
             {
                 auto lines_ending_in_v = std::max(edge.f_min, k);
                 real t1 = lines_ending_in_v*(c_fix+edge.cost);
-                real t2 = std::numeric_limits<real>::max();
-                unsigned int best_l;
-                real savings = 0;
-                for (unsigned int l = 0; l <= lines_ending_in_v && l <= childTable.getMaximalK(); l++)
+                for (; next_l <= lines_ending_in_v && next_l <= childTable.getMaximalK(); next_l++)
                 {
-                    auto x = childTable[l].cost - savings;
+                    auto x = childTable[next_l].cost - savings;
                     if (x < t2)
                     {
                         t2 = x;
-                        best_l = l;
+                        best_l = next_l;
                     }
                     savings += c_fix;
                 }
-                parentIntroductionTable[k].cost = t1+t2;
-                LineConcept solution = childTable[best_l].solution;
-                LineConcept split = solution.splitOffLines(best_l);
-                split.extendLines(edgeIndex);
-                solution += split;
-                unsigned int newlineFreq = lines_ending_in_v-best_l;
-                if (newlineFreq > 0)
-                    solution += Line(newlineFreq, edgeIndex);
-                parentIntroductionTable[k].solution = solution;
+                parentIntroductionTable[k] = {t1+t2, 0, best_l};
             }
             return parentIntroductionTable;
         }
 
-        OptimaTable mergeOperation(const OptimaTable &ot1, const OptimaTable &ot2, real c_fix)
+        // the start of the longest suffix of the costs whose second differences are nonnegative, up to rounding
+        static unsigned int convexSuffixStart(const vector<real> &costs)
         {
-            OptimaTable mergedTable(ot1.getMaximalK()+ot2.getMaximalK());
-            for (unsigned int k = 0; k <= mergedTable.getMaximalK(); k++)
+            for (size_t i = costs.size() >= 2 ? costs.size()-2 : 0; i >= 1; i--)
+            {
+                if (costs[i-1]+costs[i+1] < 2*costs[i] - 1e-9*(1+std::abs(costs[i])))
+                    return i;
+            }
+            return 0;
+        }
+
+        // min-plus convolution c[s] = min_{i+j=s} a[i]+b[j], arg[s] is the i of a minimum. Convex a and b are
+        // merged by their slopes in linear time. If only b is convex, the minimising i grows with s and the minima are
+        // found by divide and conquer over s in O(n log n); otherwise all pairs are tried.
+        static void minPlusConvolution(std::span<const real> a, bool aConvex, std::span<const real> b, bool bConvex,
+                                       vector<real> &c, vector<unsigned int> &arg)
+        {
+            int n = a.size()-1, m = b.size()-1;
+            c.assign(n+m+1, std::numeric_limits<real>::max());
+            arg.assign(n+m+1, 0);
+            if (aConvex && bConvex)
+            {
+                int i = 0, j = 0;
+                c[0] = a[0]+b[0];
+                for (int s = 1; s <= n+m; s++)
+                {
+                    if (j == m || (i < n && a[i+1]-a[i] <= b[j+1]-b[j]))
+                        i++;
+                    else
+                        j++;
+                    c[s] = a[i]+b[j];
+                    arg[s] = i;
+                }
+            }
+            else if (bConvex)
+            {
+                auto rowMinima = [&](auto &self, int sLo, int sHi, int iLo, int iHi) -> void
+                {
+                    if (sLo > sHi)
+                        return;
+                    int s = (sLo+sHi)/2;
+                    int best = std::max(iLo, s-m);
+                    for (int i = best; i <= std::min(iHi, s); i++)
+                    {
+                        if (a[i]+b[s-i] < c[s])
+                        {
+                            c[s] = a[i]+b[s-i];
+                            best = i;
+                        }
+                    }
+                    arg[s] = best;
+                    self(self, sLo, s-1, iLo, best);
+                    self(self, s+1, sHi, best, iHi);
+                };
+                rowMinima(rowMinima, 0, n+m, 0, n);
+            }
+            else if (aConvex)
+            {
+                minPlusConvolution(b, bConvex, a, aConvex, c, arg);
+                for (int s = 0; s <= n+m; s++)
+                    arg[s] = s-arg[s];
+            }
+            else
             {
-                real min_cost = std::numeric_limits<real>::max();
-                // minimum admissible k1: k-ot2.getMaximalK() = k1
-                // maximum admissible k1: k1 = ot1.getMaximalK()
-                // no possible k1 iff: k > ot1.getMaximalK()+ot2.getMaximalK()
-                unsigned int best_l;
-                unsigned int best_k1;
-                for (unsigned int k1 = k>ot2.getMaximalK() ? k-ot2.getMaximalK() : 0; k1 <= k && k1 <= ot1.getMaximalK(); k1++)
+                for (int i = 0; i <= n; i++)
                 {
-                    unsigned int k2 = k-k1;
-                    real savings = 0;
-                    for (unsigned int l = 0; l+k1 <= ot1.getMaximalK() && l+k2 <= ot2.getMaximalK(); l++)
+                    for (int j = 0; j <= m; j++)
                     {
-                        auto x = ot1[k1+l].cost+ot2[k2+l].cost-savings;
-                        if (x < min_cost)
+                        if (a[i]+b[j] < c[i+j])
                         {
-                            min_cost = x;
-                            best_l = l;
-                            best_k1 = k1;
+                            c[i+j] = a[i]+b[j];
+                            arg[i+j] = i;
                         }
-                        savings += c_fix;
                     }
                 }
-                mergedTable[k].cost = min_cost;
-                unsigned int best_k2 = k-best_k1;
-                LineConcept sol1 = ot1[best_k1+best_l].solution;
-                LineConcept sol2 = ot2[best_k2+best_l].solution;
-                LineConcept ms1 = sol1.splitOffLines(best_l);
-                LineConcept ms2 = sol2.splitOffLines(best_l);
-                LineConcept split1 = sol1.splitOffLines(best_k1);
-                ms1 = merge(ms1, ms2);
-                LineConcept solution = sol1;
-                solution += ms1;
-                solution += sol2;
-                solution += split1;
-                mergedTable[k].solution = solution;
             }
-            return mergedTable;
         }
 
-        void construct_tables(Subtree subtree, real c_fix)
+        // for each number l of lines merged across the node, the remaining open lines k = k1+k2 are split by a min-plus
+        // convolution of the tables shifted by l
+        OptimaTable mergeOperation(const OptimaTable &ot1, const OptimaTable &ot2, real c_fix)
         {
-            if (subtree.isLeaf())
+            unsigned int K1 = ot1.getMaximalK(), K2 = ot2.getMaximalK();
+            OptimaTable mergedTable(K1+K2);
+            for (unsigned int k = 0; k <= K1+K2; k++)
+                mergedTable[k].cost = std::numeric_limits<real>::max();
+
+            vector<real> costs1(K1+1), costs2(K2+1);
+            for (unsigned int k = 0; k <= K1; k++)
+                costs1[k] = ot1[k].cost;
+            for (unsigned int k = 0; k <= K2; k++)
+                costs2[k] = ot2[k].cost;
+            unsigned int convex1 = convexSuffixStart(costs1), convex2 = convexSuffixStart(costs2);
+
+            vector<real> c;
+            vector<unsigned int> arg;
+            for (unsigned int l = 0; l <= std::min(K1, K2); l++)
             {
-                subtree.weight().ot = leafTable();
+                minPlusConvolution(std::span<const real>(costs1).subspan(l), l >= convex1,
+                                   std::span<const real>(costs2).subspan(l), l >= convex2, c, arg);
+                real savings = l*c_fix;
+                for (unsigned int k = 0; k < c.size(); k++)
+                {
+                    if (c[k]-savings < mergedTable[k].cost)
+                        mergedTable[k] = {c[k]-savings, arg[k], l};
+                }
             }
-            else
+            return mergedTable;
+        }
+
+        void construct_tables(Tree &tree, real c_fix)
+        {
+            for (unsigned int v = tree.nodes.size(); v-- > 0;)
             {
-                OptimaTable mergedTable = leafTable();
+                Subtree subtree{&tree, v};
+                auto &merged = subtree.weight().merged;
+                merged = {leafTable()};
                 for (Subtree child : subtree)
                 {
-                    construct_tables(child, c_fix);
-                    const OptimaTable &childTable = child.weight().ot;
-                    const EdgeInfo &edge = child.weight().parentEdge;
-                    OptimaTable parentIntroductionTable = introduceParentNode(childTable, edge, child.weight().parentEdgeRef->index, c_fix);
-                    mergedTable = mergeOperation(mergedTable, parentIntroductionTable, c_fix);
+                    child.weight().up = introduceParentNode(child.weight().merged.back(), child.weight().parentEdge, c_fix);
+                    merged.push_back(mergeOperation(merged.back(), child.weight().up, c_fix));
+                }
+            }
+        }
+
+        // the choices are resolved top-down, then the line concepts are built bottom-up: in the line concept of a table
+        // entry with k open lines, these lines are at the back and their last edge is the one next to the node
+        LineConcept reconstruct(Tree &tree, unsigned int k)
+        {
+            unsigned int n = tree.nodes.size();
+            vector<unsigned int> need(n), needUp(n); // the entries of merged.back() and up that the optimum uses
+            need[0] = k;
+            for (unsigned int v = 0; v < n; v++)
+            {
+                const auto &node = tree.nodes[v];
+                unsigned int K = need[v];
+                for (unsigned int i = node.childCount; i-- > 0;)
+                {
+                    const Optimum &o = node.weight.merged[i+1][K];
+                    auto c = tree.al.data[node.adjacencyListIndex+i];
+                    needUp[c] = K-o.k1+o.l;
+                    need[c] = tree.nodes[c].weight.up[needUp[c]].l;
+                    K = o.k1+o.l;
+                }
+            }
+
+            vector<LineConcept> upSolutions(n);
+            LineConcept solution;
+            for (unsigned int v = n; v-- > 0;)
+            {
+                const auto &node = tree.nodes[v];
+                vector<unsigned int> K(node.childCount+1);
+                K[node.childCount] = need[v];
+                for (unsigned int i = node.childCount; i-- > 0;)
+                {
+                    const Optimum &o = node.weight.merged[i+1][K[i+1]];
+                    K[i] = o.k1+o.l;
+                }
+
+                solution = {};
+                for (unsigned int i = 0; i < node.childCount; i++)
+                {
+                    const Optimum &o = node.weight.merged[i+1][K[i+1]];
+                    auto c = tree.al.data[node.adjacencyListIndex+i];
+                    LineConcept sol1 = std::move(solution);
+                    LineConcept sol2 = std::move(upSolutions[c]);
+                    LineConcept ms1 = sol1.splitOffLines(o.l);
+                    LineConcept ms2 = sol2.splitOffLines(o.l);
+                    LineConcept split1 = sol1.splitOffLines(o.k1);
+                    ms1 = merge(ms1, ms2);
+                    solution = std::move(sol1);
+                    solution += ms1;
+                    solution += sol2;
+                    solution += split1;
+                }
+
+                if (v != 0)
+                {
+                    const EdgeInfo &edge = node.weight.parentEdge;
+                    auto edgeIndex = node.weight.parentEdgeRef->index;
+                    auto lines_ending_in_v = std::max(edge.f_min, needUp[v]);
+                    unsigned int best_l = node.weight.up[needUp[v]].l;
+                    LineConcept split = solution.splitOffLines(best_l);
+                    split.extendLines(edgeIndex);
+                    solution += split;
+                    unsigned int newlineFreq = lines_ending_in_v-best_l;
+                    if (newlineFreq > 0)
+                        solution += Line(newlineFreq, edgeIndex);
+                    upSolutions[v] = std::move(solution);
                 }
-                subtree.weight().ot = mergedTable;
             }
+            return solution;
         }
 
         /*
@@ -253,17 +381,85 @@ namespace LinePlanning
             return lc;
         }*/
 
-        LineConceptEx solve(const Instance &instance) {
+        // every connected component as its node with the smallest index and its number of nodes
+        static vector<pair<InstanceGraph::Node*, unsigned int>> components(const InstanceGraph &graph)
+        {
+            vector<InstanceGraph::Index> indices;
+            for (const auto &[i, node] : graph.nodes)
+                indices.push_back(i);
+            std::sort(indices.begin(), indices.end());
+            vector<pair<InstanceGraph::Node*, unsigned int>> result;
+            unordered_map<InstanceGraph::Node*, bool> seen;
+            for (auto i : indices)
+            {
+                auto root = graph.nodes.at(i);
+                if (seen[root])
+                    continue;
+                seen[root] = true;
+                vector<InstanceGraph::Node*> worklist{root};
+                unsigned int size = 0;
+                while (!worklist.empty())
+                {
+                    auto node = worklist.back();
+                    worklist.pop_back();
+                    size++;
+                    for (auto neighbor : node->getNeighbors())
+                    {
+                        if (!seen[neighbor])
+                        {
+                            seen[neighbor] = true;
+                            worklist.push_back(neighbor);
+                        }
+                    }
+                }
+                result.push_back({root, size});
+            }
+            return result;
+        }
+
+        bool isForest(const InstanceGraph &graph) {
+            return graph.edges.size()+components(graph).size() == graph.nodeCount();
+        }
+
+        LineConceptEx solve(const Instance &instance, unsigned int threads) {
+            if (!isForest(instance.graph))
+                throw std::runtime_error("the network is not a forest");
+            for (const auto &[i, e] : instance.graph.edges)
+            {
+                if (e->weight.f_min > e->weight.f_max)
+                    throw InfeasibleInstanceError("f_min exceeds f_max on edge " + to_string(i));
+            }
             auto wc = [](InstanceGraph::Edge* e){
                 TreeSolver::NodeInfo ni(e->weight);
                 ni.parentEdgeRef = e;
                 return ni;
             };
-            Tree tree = Tree::fromGraph(instance.graph, wc);
-            construct_tables(tree.getRoot(), instance.c_fix);
-            LineConcept lc = tree.getRoot().weight().ot[0].solution;
-            double cost = tree.getRoot().weight().ot[0].cost;
-            return LineConceptEx{lc, cost};
+
+            auto roots = components(instance.graph);
+            vector<LineConceptEx> solutions(roots.size(), LineConceptEx{{}, 0});
+            atomic<unsigned int> next = 0;
+            auto work = [&]() {
+                for (unsigned int c = next++; c < roots.size(); c = next++)
+                {
+                    Tree tree = Tree::fromGraph(instance.graph, wc, roots[c].first, roots[c].second);
+                    construct_tables(tree, instance.c_fix);
+                    solutions[c] = LineConceptEx{reconstruct(tree), tree.getRoot().weight().merged.back()[0].cost};
+                }
+            };
+            vector<future<void>> futures;
+            for (unsigned int t = 1; t < std::min<size_t>(threads, roots.size()); t++)
+                futures.push_back(std::async(std::launch::async, work));
+            work();
+            for (auto &f : futures)
+                f.get();
+
+            LineConceptEx result{{}, 0};
+            for (const auto &solution : solutions)
+            {
+                result += solution;
+                result.cost += solution.cost;
+            }
+            return result;
         }
 
         OptimaTable::OptimaTable(unsigned int maximal_k) : optima(maximal_k+1)
@@ -281,7 +477,7 @@ namespace LinePlanning
             return optima[i];
         }
 
-        NodeInfo::NodeInfo(LinePlanning::EdgeInfo edgeInfo) : parentEdge(edgeInfo), ot(0) {}
+        NodeInfo::NodeInfo(LinePlanning::EdgeInfo edgeInfo) : parentEdge(edgeInfo), parentEdgeRef(nullptr), up(0) {}
 
         NodeInfo::NodeInfo() : NodeInfo(LinePlanning::EdgeInfo{}){
         }
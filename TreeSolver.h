@@ -21,8 +21,8 @@ namespace LinePlanning
 
         struct Optimum{
             real cost;
-            //SolutionHint sol;
-            LineConcept solution;
+            // the choice that attains it: open lines kept from the first table (merge only) and lines continued or merged
+            unsigned int k1 = 0, l = 0;
         };
 
         struct OptimaTable{
@@ -36,10 +36,12 @@ namespace LinePlanning
             const Optimum& operator[](unsigned int i) const;
         };
 
+        // tables by the number of lines that end in the node and may be continued upwards
         struct NodeInfo{
             EdgeInfo parentEdge;
             InstanceGraph::Edge *parentEdgeRef;
-            OptimaTable ot;
+            std::vector<OptimaTable> merged; // merged[i]: the first i children merged, merged.back() is the table of the node
+            OptimaTable up; // the node table extended along the parent edge
 
             NodeInfo(LinePlanning::EdgeInfo edgeInfo);
             NodeInfo();
@@ -47,8 +49,14 @@ namespace LinePlanning
 
         typedef RootedNodeWeightedTree<NodeInfo> Tree;
 
-        void construct_tables(Tree::Subtree subtree, real c_fix);
-        LineConceptEx solve(const Instance &instance);
+        // children have larger node indices than their parents, so the tables are built by descending index
+        void construct_tables(Tree &tree, real c_fix);
+        // the line concept of the optimum with k open lines at the root, the tables must have been built
+        LineConcept reconstruct(Tree &tree, unsigned int k = 0);
+
+        bool isForest(const InstanceGraph &graph);
+        // the optimum of an instance whose network is a forest, its components are solved by up to threads threads
+        LineConceptEx solve(const Instance &instance, unsigned int threads = 1);
     }
 
     /*
@@ -0,0 +1,479 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <random>
+#include <optional>
+#include <numbers>
+#include <numeric>
+#include "../DataParser.h"
+#include "../TreeDecomposition.h"
+#include "../SpecializedTD.h"
+#include "../TW2ILP/Solver.h"
+#include "../util.h"
+
+using namespace LinePlanning;
+using namespace std;
+using filesystem::path;
+using TreeDecomposition::Vertex;
+
+/*
+ * Generates synthetic LinTim instances and times the stages of tw-lines on them separately.
+ * Results are written as JSON.
+ */
+
+struct GeneratedInstance {
+    string family;
+    unsigned int size;
+    unsigned int stopCount = 0;
+    vector<pair<int,int>> edges = {}; // stops are numbered 1..stopCount
+    unordered_map<int, pair<double,double>> coordinates = {};
+    // decomposition known from the construction (parent indices, root last), empty if there is none
+    vector<set<Vertex>> bags = {};
+    vector<int> parents = {};
+};
+
+typedef std::mt19937 Random;
+
+double uniform(Random &rng, double a, double b) {
+    return std::uniform_real_distribution<double>(a, b)(rng);
+}
+
+unsigned int uniformInt(Random &rng, unsigned int a, unsigned int b) {
+    return std::uniform_int_distribution<unsigned int>(a, b)(rng);
+}
+
+// size x size grid
+GeneratedInstance generateGrid(unsigned int size, Random &/*rng*/) {
+    GeneratedInstance gi{"grid", size};
+    auto stop = [&](unsigned int x, unsigned int y) {return (int)(y*size+x+1);};
+    for (unsigned int y = 0; y < size; y++) {
+        for (unsigned int x = 0; x < size; x++) {
+            gi.coordinates[stop(x, y)] = {100.*x, 100.*y};
+            if (x+1 < size)
+                gi.edges.push_back({stop(x, y), stop(x+1, y)});
+            if (y+1 < size)
+                gi.edges.push_back({stop(x, y), stop(x, y+1)});
+        }
+    }
+    gi.stopCount = size*size;
+    return gi;
+}
+
+// center with max(1, size/2) rings of 2*size spokes
+GeneratedInstance generateRings(unsigned int size, Random &/*rng*/) {
+    GeneratedInstance gi{"rings", size};
+    unsigned int rings = max(1u, size/2), spokes = 2*size;
+    auto stop = [&](unsigned int r, unsigned int s) {return (int)(2+r*spokes+s);};
+    gi.coordinates[1] = {0, 0};
+    for (unsigned int r = 0; r < rings; r++) {
+        for (unsigned int s = 0; s < spokes; s++) {
+            double angle = 2*std::numbers::pi*s/spokes;
+            gi.coordinates[stop(r, s)] = {100.*(r+1)*cos(angle), 100.*(r+1)*sin(angle)};
+            gi.edges.push_back({stop(r, s), stop(r, (s+1)%spokes)});
+            gi.edges.push_back({r == 0 ? 1 : stop(r-1, s), stop(r, s)});
+        }
+    }
+    gi.stopCount = 1+rings*spokes;
+    return gi;
+}
+
+// random recursive tree on size^2 stops
+GeneratedInstance generateTree(unsigned int size, Random &rng) {
+    GeneratedInstance gi{"tree", size};
+    gi.stopCount = max(2u, size*size);
+    gi.coordinates[1] = {0, 0};
+    vector<int> bagOfStop(gi.stopCount+1, -1);
+    // bags in construction order, root first; reversed below
+    vector<set<Vertex>> bags = {{1}};
+    vector<int> parents = {-1};
+    bagOfStop[1] = 0;
+    for (unsigned int v = 2; v <= gi.stopCount; v++) {
+        unsigned int u = uniformInt(rng, 1, v-1);
+        gi.edges.push_back({(int)u, (int)v});
+        auto [x, y] = gi.coordinates[u];
+        gi.coordinates[v] = {x+uniform(rng, -100, 100), y+uniform(rng, 50, 100)};
+        bags.push_back({u, v});
+        parents.push_back(bagOfStop[u]);
+        bagOfStop[v] = bags.size()-1;
+    }
+    for (int i = bags.size()-1; i >= 0; i--) {
+        gi.bags.push_back(bags[i]);
+        gi.parents.push_back(parents[i] < 0 ? -1 : (int)bags.size()-1-parents[i]);
+    }
+    return gi;
+}
+
+bool segmentsCross(pair<double,double> a, pair<double,double> b, pair<double,double> c, pair<double,double> d) {
+    auto orientation = [](pair<double,double> p, pair<double,double> q, pair<double,double> r) {
+        double v = (q.first-p.first)*(r.second-p.second) - (q.second-p.second)*(r.first-p.first);
+        return (v > 0) - (v < 0);
+    };
+    return orientation(a, b, c)*orientation(a, b, d) < 0 && orientation(c, d, a)*orientation(c, d, b) < 0;
+}
+
+// size^2 random points, shortest non-crossing edges among the 8 nearest neighbors, up to 2.2 edges per stop
+GeneratedInstance generatePlanar(unsigned int size, Random &rng) {
+    GeneratedInstance gi{"planar", size};
+    gi.stopCount = max(3u, size*size);
+    double extent = 100.*sqrt(gi.stopCount);
+    for (unsigned int v = 1; v <= gi.stopCount; v++) {
+        gi.coordinates[v] = {uniform(rng, 0, extent), uniform(rng, 0, extent)};
+    }
+    auto length = [&](int u, int v) {
+        auto [x1, y1] = gi.coordinates[u];
+        auto [x2, y2] = gi.coordinates[v];
+        return hypot(x1-x2, y1-y2);
+    };
+    set<pair<int,int>> candidateSet;
+    for (unsigned int u = 1; u <= gi.stopCount; u++) {
+        vector<pair<double,int>> byDistance;
+        for (unsigned int v = 1; v <= gi.stopCount; v++) {
+            if (v != u)
+                byDistance.push_back({length(u, v), v});
+        }
+        auto nearest = byDistance.begin()+min<size_t>(8, byDistance.size());
+        std::partial_sort(byDistance.begin(), nearest, byDistance.end());
+        for (auto it = byDistance.begin(); it != nearest; it++) {
+            candidateSet.insert({min<int>(u, it->second), max<int>(u, it->second)});
+        }
+    }
+    vector<pair<int,int>> candidates(candidateSet.begin(), candidateSet.end());
+    std::sort(candidates.begin(), candidates.end(), [&](auto e1, auto e2) {return length(e1.first, e1.second) < length(e2.first, e2.second);});
+
+    vector<int> component(gi.stopCount+1);
+    std::iota(component.begin(), component.end(), 0);
+    auto find = [&](int v) {
+        while (component[v] != v) {
+            v = component[v] = component[component[v]];
+        }
+        return v;
+    };
+    for (auto [u, v] : candidates) {
+        bool connects = find(u) != find(v);
+        if (!connects && gi.edges.size() >= 2.2*gi.stopCount)
+            continue;
+        bool crossing = false;
+        for (auto [a, b] : gi.edges) {
+            if (a != u && a != v && b != u && b != v && segmentsCross(gi.coordinates[u], gi.coordinates[v], gi.coordinates[a], gi.coordinates[b])) {
+                crossing = true;
+                break;
+            }
+        }
+        if (!crossing) {
+            gi.edges.push_back({u, v});
+            component[find(u)] = find(v);
+        }
+    }
+    return gi;
+}
+
+// partial k-tree on size^2 stops: every new stop is attached to a k-clique of an existing bag, keeping each edge with probability 1/2
+GeneratedInstance generatePartialKTree(unsigned int size, unsigned int k, Random &rng) {
+    GeneratedInstance gi{"ktree", size};
+    gi.stopCount = max(k+1, size*size);
+    double extent = 100.*sqrt(gi.stopCount);
+    for (unsigned int v = 1; v <= gi.stopCount; v++) {
+        gi.coordinates[v] = {uniform(rng, 0, extent), uniform(rng, 0, extent)};
+    }
+    // bags in construction order, root first; reversed below
+    vector<vector<Vertex>> bags(1);
+    vector<int> parents = {-1};
+    for (Vertex v = 1; v <= k+1; v++) {
+        bags[0].push_back(v);
+        if (v > 1)
+            gi.edges.push_back({(int)v-1, (int)v});
+        for (Vertex u = 1; u+1 < v; u++) {
+            if (uniformInt(rng, 0, 1))
+                gi.edges.push_back({(int)u, (int)v});
+        }
+    }
+    for (Vertex v = k+2; v <= gi.stopCount; v++) {
+        unsigned int parent = uniformInt(rng, 0, bags.size()-1);
+        vector<Vertex> bag = bags[parent];
+        bag.erase(bag.begin()+uniformInt(rng, 0, bag.size()-1));
+        unsigned int always = uniformInt(rng, 0, bag.size()-1);
+        for (unsigned int i = 0; i < bag.size(); i++) {
+            if (i == always || uniformInt(rng, 0, 1))
+                gi.edges.push_back({(int)bag[i], (int)v});
+        }
+        bag.push_back(v);
+        bags.push_back(bag);
+        parents.push_back(parent);
+    }
+    for (int i = bags.size()-1; i >= 0; i--) {
+        gi.bags.push_back(set<Vertex>(bags[i].begin(), bags[i].end()));
+        gi.parents.push_back(parents[i] < 0 ? -1 : (int)bags.size()-1-parents[i]);
+    }
+    return gi;
+}
+
+void writeInstance(const path &dir, const GeneratedInstance &gi, Random &rng) {
+    filesystem::create_directories(dir / "basis");
+    ofstream config(dir / "basis" / "Config.cnf");
+    config << "setting-name; setting-value" << endl;
+    config << "lpool_costs_fixed; 50" << endl;
+    config << "lpool_costs_length; 0.05" << endl;
+    config << "lpool_costs_edges; 0.05" << endl;
+    config << "ptn_draw_conversion_factor; 1" << endl;
+
+    ofstream stops(dir / "basis" / "Stop.giv");
+    stops << "# stop-id; short-name; long-name; x-coordinate; y-coordinate" << endl;
+    for (unsigned int v = 1; v <= gi.stopCount; v++) {
+        auto [x, y] = gi.coordinates.at(v);
+        stops << v << "; " << v << "; \"" << v << "\"; " << x << "; " << y << endl;
+    }
+
+    ofstream edges(dir / "basis" / "Edge.giv");
+    ofstream loads(dir / "basis" / "Load.giv");
+    edges << "#edge-ID;left-stop;right-stop;length;min travel time;max travel time" << endl;
+    loads << "# link_index; load; min_freq; max_freq" << endl;
+    int edgeId = 1;
+    for (auto [u, v] : gi.edges) {
+        auto [x1, y1] = gi.coordinates.at(u);
+        auto [x2, y2] = gi.coordinates.at(v);
+        unsigned int length = max(1., round(hypot(x1-x2, y1-y2)/10));
+        edges << edgeId << "; " << u << "; " << v << "; " << length << "; " << length << "; " << length << endl;
+        unsigned int fMin = uniformInt(rng, 0, 3);
+        unsigned int fMax = fMin+uniformInt(rng, 2, 6);
+        loads << edgeId << "; " << 70*fMin << "; " << fMin << "; " << fMax << endl;
+        edgeId++;
+    }
+}
+
+struct BenchResult {
+    string family;
+    unsigned int size = 0;
+    unsigned int stops = 0, edges = 0;
+    string tdMethod;
+    unsigned int treewidth = 0;
+    double timeGenerate = 0, timeParse = 0, timeDecomposition = 0, timeOutput = 0;
+    // of the solve, read from its Metrics::Registry: stage wall times in seconds and the named values
+    map<string, double> stageTimes, values;
+    Solver::ModelSizeEstimate predicted;
+    bool solved = false;
+    bool feasible = false;
+    string error;
+};
+
+double valueOr0(const map<string, double> &values, const string &name) {
+    auto it = values.find(name);
+    return it == values.end() ? 0 : it->second;
+}
+
+void writeJSON(ostream &os, const vector<BenchResult> &results) {
+    os << "[" << endl;
+    for (unsigned int i = 0; i < results.size(); i++) {
+        const auto &r = results[i];
+        auto stage = [&](const string &name) {return valueOr0(r.stageTimes, name);};
+        auto value = [&](const string &name) {return valueOr0(r.values, name);};
+        os << "  {";
+        os << "\"family\": " << Metrics::jsonString(r.family) << ", \"size\": " << r.size;
+        os << ", \"stops\": " << r.stops << ", \"edges\": " << r.edges;
+        os << ", \"td_method\": " << Metrics::jsonString(r.tdMethod) << ", \"treewidth\": " << r.treewidth;
+        os << ", \"time\": {\"generate\": " << r.timeGenerate << ", \"parse\": " << r.timeParse
+           << ", \"decomposition\": " << r.timeDecomposition << ", \"model_build\": " << stage("model build")
+           << ", \"solve\": " << stage("solve")+stage("dynamic program")+stage("tree solver") << ", \"reconstruction\": " << stage("reconstruction")
+           << ", \"output\": " << r.timeOutput << "}";
+        os << ", \"variables\": " << value("num_vars") << ", \"constraints\": " << value("num_constrs") << ", \"nonzeros\": " << value("num_nzs");
+        os << ", \"predicted\": {\"variables\": " << r.predicted.vars << ", \"constraints\": " << r.predicted.constrs
+           << ", \"nonzeros\": " << r.predicted.nonzeros << ", \"memory_mb\": " << r.predicted.memoryMB
+           << ", \"complete\": " << (r.predicted.complete ? "true" : "false") << "}";
+        os << ", \"solved\": " << (r.solved ? "true" : "false") << ", \"status\": " << value("status");
+        os << ", \"objective\": " << value("objective") << ", \"mip_gap\": " << value("mip_gap");
+        os << ", \"feasible\": " << (r.feasible ? "true" : "false");
+        if (!r.error.empty())
+            os << ", \"error\": " << Metrics::jsonString(r.error);
+        os << "}" << (i+1 < results.size() ? "," : "") << endl;
+    }
+    os << "]" << endl;
+}
+
+BenchResult run(const path &dir, const GeneratedInstance &gi, TreeDecomposition::Strategy tdStrategy, const Solver::Options &solverOptions) {
+    BenchResult r;
+    r.family = gi.family;
+    r.size = gi.size;
+    r.stops = gi.stopCount;
+    r.edges = gi.edges.size();
+
+    Timer timerParse;
+    Project project(dir);
+    Instance instance = project.parseInstanceFiles();
+    TreeDecomposition::Coordinates coordinates;
+    ifstream stopFile(project.input_folder / "Stop.giv");
+    for (auto &[stop, info] : parseNodeInfo(stopFile)) {
+        coordinates[stop] = {info.x, info.y};
+    }
+    r.timeParse = timerParse.get<chrono::duration<double>>().count();
+
+    // the exact solver needs Java; without it, fall back to the decomposition known from the generator, or a sweep
+    Timer timerDecomposition;
+    filesystem::create_directories(project.output_folder);
+    auto graph = TreeDecomposition::convert(instance.graph);
+    TreeDecomposition::ComputeOptions tdOptions;
+    tdOptions.strategy = tdStrategy;
+    tdOptions.coordinates = &coordinates;
+    std::optional<TreeDecomposition::TreeDecomposition> td;
+    try {
+        td.emplace(TreeDecomposition::compute(graph, project.output_folder / "out.td", tdOptions));
+        r.tdMethod = "compute";
+    } catch (std::runtime_error &e) {
+        if (!gi.bags.empty()) {
+            td.emplace(TreeDecomposition::TreeDecomposition::fromTree(gi.bags, gi.parents));
+            r.tdMethod = "generator";
+        } else {
+            td.emplace(TreeDecomposition::forCoordinates(TreeDecomposition::convert(graph), coordinates));
+            r.tdMethod = "sweep";
+        }
+    }
+    r.timeDecomposition = timerDecomposition.get<chrono::duration<double>>().count();
+    r.treewidth = td->getTreeWidth();
+
+    Solver::Options options = solverOptions;
+    Metrics::Registry metrics;
+    options.metrics = &metrics;
+    r.predicted = Solver::estimateModelSize(instance, *td, options);
+    try {
+        auto lineConcept = Solver::solve(instance, *td, options);
+        r.solved = true;
+        r.feasible = lineConcept.isFeasible(instance);
+        Timer timerOutput;
+        outputLineConcept(project.output_folder / "Line-Concept.lin", lineConcept);
+        r.timeOutput = timerOutput.get<chrono::duration<double>>().count();
+    } catch (std::runtime_error &e) {
+        r.error = e.what();
+    }
+    for (const auto &stage : metrics.getStages()) {
+        r.stageTimes[stage.name] += stage.wallTime;
+    }
+    r.values = metrics.getValues();
+    return r;
+}
+
+vector<unsigned int> parseList(const string &list) {
+    vector<unsigned int> values;
+    stringstream ss(list);
+    string item;
+    while (getline(ss, item, ',')) {
+        values.push_back(stoul(item));
+    }
+    return values;
+}
+
+int main(int argc, char** argv) {
+
+    TreeDecomposition::TD_App_Classpath = (path(argv[0]).parent_path().parent_path() / TreeDecomposition::TD_App_Classpath).string();
+
+    vector<string> families = {"grid", "rings", "tree", "planar", "ktree"};
+    vector<unsigned int> sizes = {3, 4, 5, 6};
+    unsigned int k = 3;
+    unsigned int seed = 1;
+    path workDir = "lptw-bench";
+    path outputFile;
+    auto tdStrategy = TreeDecomposition::Strategy::AUTO;
+    Solver::Options solverOptions;
+    solverOptions.enableVisualization = false;
+
+    for (int i = 1; i < argc; i++) {
+        string par = argv[i];
+        if (par == "-h" || par == "-help") {
+            cout << "usage: " << path(argv[0]).filename().string() << " <optional parameters>" << endl;
+            cout << "optional parameters:" << endl;
+            cout << "  -families=<list>: comma separated, out of grid,rings,tree,planar,ktree (default: all)" << endl;
+            cout << "  -sizes=<list>: comma separated size parameters (default: 3,4,5,6)" << endl;
+            cout << "    grid: size x size, rings: size/2 rings of 2*size spokes, tree/planar/ktree: size^2 stops" << endl;
+            cout << "  -k=<value>: width of the partial k-trees (default: 3)" << endl;
+            cout << "  -seed=<value>: random seed (default: 1)" << endl;
+            cout << "  -t<value>: time limit for ILP solving, in seconds" << endl;
+            cout << "  -td-sweep, -td-separator, -td-exact: tree decomposition strategy" << endl;
+            cout << "  -dir=<path>: directory for the generated instances (default: lptw-bench)" << endl;
+            cout << "  -o=<file>: JSON output file (default: <dir>/results.json)" << endl;
+            return 0;
+        }
+        else if (par.starts_with("-families=")) {
+            families.clear();
+            stringstream ss(par.substr(10));
+            string item;
+            while (getline(ss, item, ',')) {
+                families.push_back(item);
+            }
+        }
+        else if (par.starts_with("-sizes=")) {
+            sizes = parseList(par.substr(7));
+        }
+        else if (par.starts_with("-k=")) {
+            k = stoul(par.substr(3));
+        }
+        else if (par.starts_with("-seed=")) {
+            seed = stoul(par.substr(6));
+        }
+        else if (par == "-td-sweep") {
+            tdStrategy = TreeDecomposition::Strategy::SWEEP;
+        }
+        else if (par == "-td-separator") {
+            tdStrategy = TreeDecomposition::Strategy::SEPARATOR;
+        }
+        else if (par == "-td-exact") {
+            tdStrategy = TreeDecomposition::Strategy::EXACT;
+        }
+        else if (par.starts_with("-t")) {
+            solverOptions.maxSolveTimeILP = stod(par.substr(2));
+        }
+        else if (par.starts_with("-dir=")) {
+            workDir = par.substr(5);
+        }
+        else if (par.starts_with("-o=")) {
+            outputFile = par.substr(3);
+        }
+        else {
+            cout << "unknown parameter: " << par << endl;
+        }
+    }
+    if (outputFile.empty())
+        outputFile = workDir / "results.json";
+
+    vector<BenchResult> results;
+    for (const auto &family : families) {
+        for (auto size : sizes) {
+            Random rng(seed);
+            Timer timerGenerate;
+            GeneratedInstance gi;
+            if (family == "grid") {
+                gi = generateGrid(size, rng);
+            } else if (family == "rings") {
+                gi = generateRings(size, rng);
+            } else if (family == "tree") {
+                gi = generateTree(size, rng);
+            } else if (family == "planar") {
+                gi = generatePlanar(size, rng);
+            } else if (family == "ktree") {
+                gi = generatePartialKTree(size, k, rng);
+            } else {
+                cerr << "unknown family: " << family << endl;
+                return 1;
+            }
+            path dir = workDir / (family+"-"+to_string(size));
+            filesystem::remove_all(dir);
+            writeInstance(dir, gi, rng);
+            double timeGenerate = timerGenerate.get<chrono::duration<double>>().count();
+
+            cout << "=== " << family << " " << size << " ===" << endl;
+            try {
+                auto r = run(dir, gi, tdStrategy, solverOptions);
+                r.timeGenerate = timeGenerate;
+                results.push_back(r);
+            } catch (std::runtime_error &e) {
+                BenchResult r;
+                r.family = family;
+                r.size = size;
+                r.error = e.what();
+                results.push_back(r);
+            }
+            // keep the results of finished runs if a later one crashes
+            ofstream json(outputFile);
+            writeJSON(json, results);
+        }
+    }
+    cout << "results: " << outputFile << endl;
+    return 0;
+}
@@ -0,0 +1,298 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <new>
+#include <cstdlib>
+#include <numeric>
+#include <algorithm>
+#include "../TW2ILP/PathPattern.h"
+#include "../test/CoupledPP.h"
+
+using namespace std;
+
+/*
+ * Times the path pattern kernels (allPatterns, forget, extensions, subdivisions, joins, rename, hashing, equality)
+ * for all encodings and bag sizes, and checks via CoupledPP that the encodings agree.
+ */
+
+// every heap allocation of the process is counted
+static size_t allocationCount = 0;
+
+void* operator new(size_t size) {
+    allocationCount++;
+    if (void *p = std::malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+// keeps the compiler from discarding the benchmarked results
+static volatile size_t sink = 0;
+
+typedef std::mt19937 Random;
+
+// random pattern on vertices 1..k; the number of proper vertices is drawn proportionally to the number of patterns having it
+vector<char> randomPattern(unsigned int k, Random &rng) {
+    vector<double> weights(k+1, 0.);
+    double arrangements = 1.;
+    for (unsigned int j = 1; j <= k; j++) {
+        arrangements *= k-j+1;
+        weights[j] = arrangements*std::pow(2., j+1);
+    }
+    unsigned int j = std::discrete_distribution<unsigned int>(weights.begin(), weights.end())(rng);
+    vector<char> vertices(k);
+    std::iota(vertices.begin(), vertices.end(), 1);
+    std::shuffle(vertices.begin(), vertices.end(), rng);
+    vector<char> pattern;
+    std::bernoulli_distribution square(0.5);
+    for (unsigned int i = 0; i <= j; i++) {
+        if (square(rng) || (j == 1 && i == 1 && pattern.size() == 1))
+            pattern.push_back(PathPatternVec::SQ);
+        if (i < j)
+            pattern.push_back(vertices[i]);
+    }
+    return pattern;
+}
+
+struct Sample {
+    vector<char> pattern;
+    char forgetVertex;
+    char newVertex; // not in the pattern, 0 if the pattern contains all vertices
+};
+
+vector<Sample> randomSamples(unsigned int k, unsigned int count, Random &rng) {
+    vector<Sample> samples;
+    for (unsigned int i = 0; i < count; i++) {
+        Sample s{randomPattern(k, rng), (char)std::uniform_int_distribution<int>(1, k)(rng), 0};
+        vector<char> missing;
+        for (char c = 1; c <= (char)k; c++) {
+            if (std::find(s.pattern.begin(), s.pattern.end(), c) == s.pattern.end())
+                missing.push_back(c);
+        }
+        if (!missing.empty())
+            s.newVertex = missing[std::uniform_int_distribution<size_t>(0, missing.size()-1)(rng)];
+        samples.push_back(std::move(s));
+    }
+    return samples;
+}
+
+struct Measurement {
+    string encoding;
+    unsigned int k;
+    string operation;
+    double nsPerOp;
+    double allocationsPerOp;
+    size_t ops;
+};
+
+class Bench {
+    double minSeconds;
+
+public:
+    vector<Measurement> measurements;
+
+    explicit Bench(double minSeconds) : minSeconds(minSeconds) {}
+
+    // repeats body (which performs opsPerRound operations) until minSeconds have passed
+    void measure(const string &encoding, unsigned int k, const string &operation, size_t opsPerRound, const std::function<void()> &body) {
+        if (opsPerRound == 0)
+            return;
+        size_t rounds = 0;
+        size_t allocations = allocationCount;
+        auto start = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            body();
+            rounds++;
+            elapsed = std::chrono::steady_clock::now()-start;
+        } while (elapsed.count() < minSeconds);
+        allocations = allocationCount-allocations;
+        size_t ops = rounds*opsPerRound;
+        measurements.push_back({encoding, k, operation, elapsed.count()*1e9/ops, (double)allocations/ops, ops});
+        cout << left << setw(10) << encoding << right << setw(4) << k << "  " << left << setw(14) << operation << right
+             << setw(14) << fixed << setprecision(1) << measurements.back().nsPerOp
+             << setw(12) << setprecision(2) << measurements.back().allocationsPerOp
+             << setw(12) << ops << endl;
+    }
+};
+
+template <class PP>
+void benchEncoding(Bench &bench, const string &encoding, unsigned int k, const vector<Sample> &samples, bool enumerate, Random &rng) {
+    if (enumerate) {
+        bench.measure(encoding, k, "allPatterns", 1, [&]() {
+            sink = sink + PP::allPatterns(k).size();
+        });
+    }
+
+    vector<PP> patterns, reversedPatterns;
+    for (const auto &s : samples) {
+        patterns.emplace_back(s.pattern);
+        reversedPatterns.emplace_back(vector<char>{s.pattern.rbegin(), s.pattern.rend()});
+    }
+    vector<char> renaming(k+1, 0);
+    std::iota(renaming.begin()+1, renaming.end(), 1);
+    std::shuffle(renaming.begin()+1, renaming.end(), rng);
+    size_t withNewVertex = std::count_if(samples.begin(), samples.end(), [](const Sample &s) {return s.newVertex != 0;});
+
+    bench.measure(encoding, k, "forget", patterns.size(), [&]() {
+        for (size_t i = 0; i < patterns.size(); i++) {
+            sink = sink + patterns[i].forget(samples[i].forgetVertex).has_value();
+        }
+    });
+    bench.measure(encoding, k, "extensions", withNewVertex, [&]() {
+        for (size_t i = 0; i < patterns.size(); i++) {
+            if (samples[i].newVertex != 0)
+                sink = sink + patterns[i].extensions(samples[i].newVertex).size();
+        }
+    });
+    bench.measure(encoding, k, "subdivisions", withNewVertex, [&]() {
+        for (size_t i = 0; i < patterns.size(); i++) {
+            if (samples[i].newVertex != 0)
+                sink = sink + patterns[i].subdivisions(samples[i].newVertex).size();
+        }
+    });
+    bench.measure(encoding, k, "joins", patterns.size(), [&]() {
+        for (const auto &pp : patterns) {
+            sink = sink + pp.joins().size();
+        }
+    });
+    bench.measure(encoding, k, "rename", patterns.size(), [&]() {
+        for (const auto &pp : patterns) {
+            sink = sink + std::hash<PP>()(pp.rename([&](char c) {return renaming[c];}));
+        }
+    });
+    bench.measure(encoding, k, "hash", patterns.size(), [&]() {
+        for (const auto &pp : patterns) {
+            sink = sink + std::hash<PP>()(pp);
+        }
+    });
+    // half of the comparisons are between equal patterns given in opposite directions
+    bench.measure(encoding, k, "==", 2*patterns.size(), [&]() {
+        for (size_t i = 0; i < patterns.size(); i++) {
+            sink = sink + (patterns[i] == reversedPatterns[i]);
+            sink = sink + (patterns[i] == reversedPatterns[(i+1)%patterns.size()]);
+        }
+    });
+}
+
+// throws if PPO and PathPatternVec disagree on any of the samples
+template <class PPO>
+void crossCheck(unsigned int k, const vector<Sample> &samples, bool enumerate) {
+    typedef CoupledPPT<PPO> CPP;
+    if (enumerate)
+        CPP::allPatterns(k);
+    for (unsigned int i = 0; i < samples.size(); i++) {
+        const auto &s = samples[i];
+        CPP pp{s.pattern};
+        pp.forget(s.forgetVertex);
+        if (s.newVertex != 0) {
+            pp.extensions(s.newVertex);
+            pp.subdivisions(s.newVertex);
+        }
+        pp.joins();
+        pp.rename([k](char c) {return (char)(k+1-c);});
+        pp == CPP{vector<char>{s.pattern.rbegin(), s.pattern.rend()}};
+        pp == CPP{samples[(i+1)%samples.size()].pattern};
+    }
+}
+
+int main(int argc, char** argv) {
+
+    unsigned int maxK = PathPatternOptimized<unsigned long long>::maxBagSize;
+    unsigned int maxEnumerateK = 6;
+    unsigned int sampleCount = 1000;
+    unsigned int seed = 1;
+    double minSeconds = 0.05;
+    bool check = true;
+    string outputFile;
+
+    for (int i = 1; i < argc; i++) {
+        string par = argv[i];
+        if (par == "-h" || par == "-help") {
+            cout << "usage: pattern_bench <optional parameters>" << endl;
+            cout << "optional parameters:" << endl;
+            cout << "  -k=<value>: largest bag size (default: " << maxK << ", the maximum of the 64 bit encoding)" << endl;
+            cout << "  -enumerate-k=<value>: largest bag size for allPatterns (default: " << maxEnumerateK << ")" << endl;
+            cout << "  -samples=<value>: random patterns per bag size (default: " << sampleCount << ")" << endl;
+            cout << "  -seed=<value>: random seed (default: " << seed << ")" << endl;
+            cout << "  -min-time=<value>: minimal time per measurement, in seconds (default: " << minSeconds << ")" << endl;
+            cout << "  -no-check: skip the comparison of the encodings" << endl;
+            cout << "  -o=<file>: CSV output file" << endl;
+            return 0;
+        }
+        else if (par.starts_with("-k=")) {
+            maxK = stoul(par.substr(3));
+        }
+        else if (par.starts_with("-enumerate-k=")) {
+            maxEnumerateK = stoul(par.substr(13));
+        }
+        else if (par.starts_with("-samples=")) {
+            sampleCount = stoul(par.substr(9));
+        }
+        else if (par.starts_with("-seed=")) {
+            seed = stoul(par.substr(6));
+        }
+        else if (par.starts_with("-min-time=")) {
+            minSeconds = stod(par.substr(10));
+        }
+        else if (par == "-no-check") {
+            check = false;
+        }
+        else if (par.starts_with("-o=")) {
+            outputFile = par.substr(3);
+        }
+        else {
+            cout << "unknown parameter: " << par << endl;
+        }
+    }
+
+    typedef PathPatternOptimized<unsigned int> PPO32;
+    typedef PathPatternOptimized<unsigned long long> PPO64;
+
+    Bench bench(minSeconds);
+    cout << left << setw(10) << "encoding" << right << setw(4) << "k" << "  " << left << setw(14) << "operation" << right
+         << setw(14) << "ns/op" << setw(12) << "allocs/op" << setw(12) << "ops" << endl;
+    for (unsigned int k = 2; k <= maxK; k++) {
+        Random rng(seed+k);
+        auto samples = randomSamples(k, sampleCount, rng);
+        bool enumerate = k <= maxEnumerateK;
+
+        if (check) {
+            try {
+                if (k <= PPO32::maxBagSize)
+                    crossCheck<PPO32>(k, samples, enumerate);
+                if (k <= PPO64::maxBagSize)
+                    crossCheck<PPO64>(k, samples, enumerate);
+            } catch (std::runtime_error &e) {
+                cerr << "encodings disagree for k = " << k << endl;
+                return 1;
+            }
+        }
+
+        benchEncoding<PathPatternVec>(bench, "vec", k, samples, enumerate, rng);
+        if (k <= PPO32::maxBagSize)
+            benchEncoding<PPO32>(bench, "opt32", k, samples, enumerate, rng);
+        if (k <= PPO64::maxBagSize)
+            benchEncoding<PPO64>(bench, "opt64", k, samples, enumerate, rng);
+    }
+
+    if (!outputFile.empty()) {
+        ofstream out(outputFile);
+        out << "encoding,k,operation,ns_per_op,allocations_per_op,ops" << endl;
+        for (const auto &m : bench.measurements) {
+            out << m.encoding << "," << m.k << "," << m.operation << "," << m.nsPerOp << "," << m.allocationsPerOp << "," << m.ops << endl;
+        }
+    }
+    return 0;
+}
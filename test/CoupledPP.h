@@ -5,14 +5,13 @@
 #include <set>
 #include "../TW2ILP/PathPattern.h"
 
-typedef PathPatternOptimized<unsigned int> PPO;
-
 using namespace std;
 
 /*
  * Class for debugging/testing; asserts that two PP data structures behave the same way.
  */
-class CoupledPP {
+template <class PPO>
+class CoupledPPT {
 
 public:
     PPO my_ppo;
@@ -20,15 +19,15 @@ public:
 
     static constexpr char SQ = 0;
 
-    CoupledPP(PPO ppo, PathPatternVec ppv) : my_ppo(ppo), my_ppv(ppv) {
+    CoupledPPT(PPO ppo, PathPatternVec ppv) : my_ppo(ppo), my_ppv(ppv) {
         check();
     }
 
-    CoupledPP(vector<char> raw) : my_ppo(raw), my_ppv(raw)  {
+    CoupledPPT(vector<char> raw) : my_ppo(raw), my_ppv(raw)  {
         check();
     }
 
-    CoupledPP(array<char, 2> raw) : my_ppo(raw), my_ppv(raw)  {
+    CoupledPPT(array<char, 2> raw) : my_ppo(raw), my_ppv(raw)  {
         check();
     }
 
@@ -41,8 +40,8 @@ public:
             throw runtime_error("");
     }
 
-    static CoupledPP couple(const PPO &ppo, const PathPatternVec &ppv) {
-        CoupledPP pp{ppo, ppv};
+    static CoupledPPT couple(const PPO &ppo, const PathPatternVec &ppv) {
+        CoupledPPT pp{ppo, ppv};
         return pp;
     }
 
@@ -54,13 +53,13 @@ public:
     }
 
     template <class Container1, class Container2>
-    static vector<CoupledPP> coupleAll(const Container1 &ppos, const Container2 &ppvs) {
+    static vector<CoupledPPT> coupleAll(const Container1 &ppos, const Container2 &ppvs) {
         set<PathPatternVec> s1{ppvs.begin(), ppvs.end()};
         set<PathPatternVec> s2;
         for (auto pp : ppos) {
             s2.insert(PathPatternVec{toVector(pp)});
         }
-        vector<CoupledPP> r;
+        vector<CoupledPPT> r;
         for (auto pp : assert_eq_and_return(s1, s2)) {
             r.emplace_back(toVector(pp));
         }
@@ -71,11 +70,11 @@ public:
         return assert_eq_and_return(my_ppo.containsEdge(c1, c2), my_ppv.containsEdge(c1,c2));
     }
 
-    auto operator==(const CoupledPP &o) const {
+    auto operator==(const CoupledPPT &o) const {
         return assert_eq_and_return(my_ppo == o.my_ppo, my_ppv == o.my_ppv);
     }
 
-    std::optional<CoupledPP> forget(char c) const {
+    std::optional<CoupledPPT> forget(char c) const {
         auto o1 = my_ppo.forget(c);
         auto o2 = my_ppv.forget(c);
         if (assert_eq_and_return(o1.has_value(),o2.has_value())) {
@@ -85,43 +84,65 @@ public:
         }
     }
 
-    vector<CoupledPP> extensions(char newV) const {
+    vector<CoupledPPT> extensions(char newV) const {
         return coupleAll(my_ppo.extensions(newV), my_ppv.extensions(newV));
     }
 
-    vector<CoupledPP> subdivisions(char newV) const {
+    vector<CoupledPPT> subdivisions(char newV) const {
         return coupleAll(my_ppo.subdivisions(newV), my_ppv.subdivisions(newV));
     }
 
-    vector<std::pair<CoupledPP,CoupledPP>> joins() const {
-        throw runtime_error("");
+    // the encodings may enumerate the joins in a different order and with swapped halves, so compare them as multisets of unordered pairs
+    template <class Container>
+    static multiset<pair<PathPatternVec,PathPatternVec>> normalizedJoins(const Container &joins) {
+        multiset<pair<PathPatternVec,PathPatternVec>> s;
+        for (const auto &[pp1, pp2] : joins) {
+            PathPatternVec v1{toVector(pp1)}, v2{toVector(pp2)};
+            s.insert(v2 < v1 ? make_pair(v2, v1) : make_pair(v1, v2));
+        }
+        return s;
+    }
 
-        vector<std::pair<CoupledPP,CoupledPP>> r;
-        //unchecked
-        for (auto p : my_ppo.joins()) {
-            r.push_back(make_pair(CoupledPP{toVector(p.first)}, CoupledPP{toVector(p.second)}));
+    vector<std::pair<CoupledPPT,CoupledPPT>> joins() const {
+        vector<std::pair<CoupledPPT,CoupledPPT>> r;
+        for (const auto &[pp1, pp2] : assert_eq_and_return(normalizedJoins(my_ppo.joins()), normalizedJoins(my_ppv.joins()))) {
+            r.push_back(make_pair(CoupledPPT{toVector(pp1)}, CoupledPPT{toVector(pp2)}));
         }
         return r;
     }
 
+    std::optional<CoupledPPT> join(const CoupledPPT &other) const {
+        auto o1 = my_ppo.join(other.my_ppo);
+        auto o2 = my_ppv.join(other.my_ppv);
+        if (assert_eq_and_return(o1.has_value(), o2.has_value())) {
+            return couple(o1.value(), o2.value());
+        } else {
+            return {};
+        }
+    }
+
     template <class T>
-    CoupledPP rename(T renaming) const {
+    CoupledPPT rename(T renaming) const {
         return couple(my_ppo.rename(renaming), my_ppv.rename(renaming));
     }
 
-    static vector<CoupledPP> allPatterns(int numVertices) {
+    static vector<CoupledPPT> allPatterns(int numVertices) {
         return coupleAll(decltype(my_ppo)::allPatterns(numVertices), decltype(my_ppv)::allPatterns(numVertices));
     }
 };
 
-vector<char> toVector(const CoupledPP &pp) {
+typedef PathPatternOptimized<unsigned int> PPO;
+typedef CoupledPPT<PPO> CoupledPP;
+
+template <class PPO>
+vector<char> toVector(const CoupledPPT<PPO> &pp) {
     return toVector(pp.my_ppv);
 }
 
 
-template<> struct std::hash<CoupledPP>
+template<class PPO> struct std::hash<CoupledPPT<PPO>>
 {
-    std::size_t operator()(CoupledPP const& pp) const
+    std::size_t operator()(CoupledPPT<PPO> const& pp) const
     {
         return std::hash<PPO>()(pp.my_ppo);
     }
@@ -0,0 +1,64 @@
+#include "../Solver.h"
+#include "../TreeSolver.h"
+#include <iostream>
+#include <cmath>
+
+using namespace LinePlanning;
+using namespace std;
+using TreeDecomposition::Vertex;
+
+/*
+ * Decompositions on which the dynamic program once missed the optimum. The networks are trees, so the DP optimum
+ * on every decomposition has to match the tree solver. Exits with 1 on a mismatch.
+ */
+
+struct Edge {
+    int u, v;
+    unsigned int fMin, fMax;
+};
+
+struct Case {
+    string name;
+    vector<Edge> edges;
+    vector<set<Vertex>> bags; // a path decomposition, the last bag is the root
+};
+
+Instance makeInstance(const vector<Edge> &edges) {
+    Instance instance;
+    instance.c_fix = 50;
+    int id = 1;
+    for (const auto &e : edges) {
+        auto edge = instance.graph.addEdge(id++, e.u, e.v);
+        edge->weight = EdgeInfoEx(e.fMin, e.fMax);
+        edge->weight.length = 1;
+        edge->weight.cost = 0.1;
+    }
+    return instance;
+}
+
+TreeDecomposition::TreeDecomposition pathDecomposition(const vector<set<Vertex>> &bags) {
+    vector<int> parents;
+    for (unsigned int i = 0; i < bags.size(); i++) {
+        parents.push_back(i+1 < bags.size() ? (int)i+1 : -1);
+    }
+    return TreeDecomposition::TreeDecomposition::fromTree(bags, parents);
+}
+
+int main() {
+    vector<Case> cases = {
+        // 4 is forgotten between 3 and 5, while 1 is already forgotten: its pattern in the middle bag is "? 4 ?"
+        {"path 1-3-4-5", {{1, 3, 1, 1}, {3, 4, 1, 1}, {4, 5, 1, 1}}, {{1, 3}, {3, 4, 5}, {3, 5}}},
+        {"path 1-3-4-5, reversed", {{1, 3, 1, 1}, {3, 4, 1, 1}, {4, 5, 1, 1}}, {{3, 5}, {3, 4, 5}, {1, 3}}},
+    };
+
+    bool ok = true;
+    for (const auto &c : cases) {
+        auto instance = makeInstance(c.edges);
+        auto expected = TreeSolver::solve(instance).cost;
+        auto cost = Solver::solve(instance, pathDecomposition(c.bags))->cost;
+        bool match = std::abs(cost-expected) <= 1e-9*(1+std::abs(expected));
+        cout << (match ? "ok   " : "FAIL ") << c.name << ": DP " << cost << ", tree solver " << expected << endl;
+        ok = ok && match;
+    }
+    return ok ? 0 : 1;
+}